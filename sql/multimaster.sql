@@ -29,6 +29,23 @@ truncate local_tab;
 \c :node1
 table local_tab;
 
+-- copy into local table stays local, while replicated table written in the
+-- same transaction still gets replicated
+create table repl_tab(id int primary key);
+begin;
+copy local_tab from stdin;
+10
+\.
+insert into repl_tab values (1);
+commit;
+-- nothing to replicate here: no rows matched
+update repl_tab set id = id + 1 where id < 0;
+\c :node2
+table local_tab;
+table repl_tab;
+\c :node1
+table local_tab;
+
 -- check that implicit empty transactions works fine
 create table t (a int, b text);
 create or replace function f1() returns trigger as $$begin raise notice 'b: %', new.b; return NULL; end$$ language plpgsql;
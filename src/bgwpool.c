@@ -32,6 +32,7 @@
 #include "state.h"
 #include "logger.h"
 #include "mtm_utils.h"
+#include "pglogical_relid_map.h"
 
 /*
  * Store the size of tx body, position of it in the tx list and transaction
@@ -99,6 +100,10 @@ BgwPoolStart(int sender_node_id, char *poolName, Oid db_id, Oid user_id)
 	ConditionVariableInit(&poolDesc->txlist.syncpoint_cv);
 	ConditionVariableInit(&poolDesc->txlist.transaction_cv);
 
+	poolDesc->relnames_tranche = LWLockNewTrancheId();
+	pglogical_relnames_create(poolDesc->relnames_tranche,
+							  &poolDesc->relnames_area,
+							  &poolDesc->relnames_table);
 }
 
 /*
@@ -215,6 +220,9 @@ BgwPoolMainLoop(BgwPool *poolDesc)
 		elog(FATAL, "dsm_attach failed, looks like receiver is exiting");
 	dsm_pin_mapping(seg);
 	queue = dsm_segment_address(seg);
+	pglogical_relnames_attach(poolDesc->relnames_tranche,
+							  poolDesc->relnames_area,
+							  poolDesc->relnames_table);
 
 	MtmIsPoolWorker = true;
 	/* Run as replica session replication role. */
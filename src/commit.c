@@ -54,8 +54,18 @@ static struct MtmCommitState
 	GlobalTx *gtx;
 	bool	inside_commit_sequence;
 	MemoryContext mctx;
+	/*
+	 * With MtmPipelineCommitAcks, commit acks of the last xact (gid above)
+	 * from this cohort are collected at the start of the next one; xid<N>
+	 * stream stays subscribed meanwhile.
+	 */
+	bool	acks_pending;
+	nodemask_t acks_cohort;
+	uint64	acks_gen_num;
 } mtm_commit_state;
 
+static void MtmWaitPendingCommitAcks(void);
+
 static void
 pubsub_change_cb(Datum arg, int cacheid, uint32 hashvalue)
 {
@@ -116,6 +126,7 @@ mtm_commit_cleanup(int status, Datum arg)
 {
 	ReleasePB();
 	dmq_stream_unsubscribe();
+	mtm_commit_state.acks_pending = false;
 
 	if (mtm_commit_state.gtx != NULL)
 	{
@@ -185,6 +196,9 @@ MtmBeginTransaction()
 	/* Set this on tx start, to avoid resetting in error handler */
 	AllowTempIn2PC = false;
 
+	/* previous xact of the session is committed only when acked */
+	MtmWaitPendingCommitAcks();
+
 	/* XXX: clean MtmTx on commit and check on begin that it is clean. */
 	/* That should unveil probable issues with subxacts. */
 
@@ -300,34 +314,86 @@ MtmGenerateGid(char *gid, int node_id, TransactionId xid, uint64 gen_num)
 	return;
 }
 
+/*
+ * Read unsigned decimal number at *p and advance past it. Returns false if
+ * there are no digits.
+ */
+static inline bool
+gid_read_number(const char **p, uint64 *val)
+{
+	const char *c = *p;
+	uint64		v = 0;
+
+	if (*c < '0' || *c > '9')
+		return false;
+	while (*c >= '0' && *c <= '9')
+		v = v * 10 + (*c++ - '0');
+
+	*val = v;
+	*p = c;
+	return true;
+}
+
+/*
+ * Parse gid generated by MtmGenerateGid. Returns false for anything else,
+ * e.g. user gid of explicit 2PC.
+ *
+ * This is on the path of each PREPARE and status request, so do it by hand
+ * instead of sscanf.
+ */
+bool
+MtmGidParse(const char *gid, MtmGid *parsed)
+{
+	const char *p = gid;
+	uint64		node_id;
+	uint64		xid;
+	uint64		gen_num;
+
+	if (IS_EXPLICIT_2PC_GID(gid))
+		return false;
+	p += 4;
+
+	if (!gid_read_number(&p, &node_id) || *p++ != '-' ||
+		!gid_read_number(&p, &xid) || *p++ != '-' ||
+		!gid_read_number(&p, &gen_num) || *p != '\0')
+		return false;
+
+	parsed->node_id = (int) node_id;
+	parsed->xid = (TransactionId) xid;
+	parsed->gen_num = gen_num;
+	return true;
+}
+
 uint64
 MtmGidParseGenNum(const char *gid)
 {
-	uint64 gen_num = MtmInvalidGenNum;
-	TransactionId xid;
+	MtmGid		parsed;
 
-	sscanf(gid, "MTM-%*d-" XID_FMT "-%" INT64_MODIFIER "X", &xid, &gen_num);
-	Assert(gen_num != MtmInvalidGenNum);
-	return gen_num;
+	if (!MtmGidParse(gid, &parsed))
+		parsed.gen_num = MtmInvalidGenNum;
+	Assert(parsed.gen_num != MtmInvalidGenNum);
+	return parsed.gen_num;
 }
 
 int
 MtmGidParseNodeId(const char *gid)
 {
-	int			node_id = -1;
+	MtmGid		parsed;
 
-	sscanf(gid, "MTM-%d-%*d", &node_id);
-	return node_id;
+	if (!MtmGidParse(gid, &parsed))
+		return -1;
+	return parsed.node_id;
 }
 
 TransactionId
 MtmGidParseXid(const char *gid)
 {
-	TransactionId xid = InvalidTransactionId;
+	MtmGid		parsed;
 
-	sscanf(gid, "MTM-%*d-" XID_FMT, &xid);
-	Assert(xid != InvalidTransactionId);
-	return xid;
+	if (!MtmGidParse(gid, &parsed))
+		parsed.xid = InvalidTransactionId;
+	Assert(parsed.xid != InvalidTransactionId);
+	return parsed.xid;
 }
 
 /* ensure we get the right PREPARE ack */
@@ -354,6 +420,173 @@ Paxos2AGatherHook(MtmMessage *anymsg, Datum arg)
 	return strcmp(msg->gid, gid) == 0;
 }
 
+/*
+ * Commit acks are collected from the same stream as 2A responses; skip late
+ * duplicate precommit acks (peer might answer both to direct precommit and
+ * to the one it decoded from WAL).
+ */
+static bool
+CommitAckGatherHook(MtmMessage *anymsg, Datum arg)
+{
+	Mtm2AResponse *msg = (Mtm2AResponse *) anymsg;
+
+	if (!Paxos2AGatherHook(anymsg, arg))
+		return false;
+	return msg->status != GTXPreCommitted;
+}
+
+/*
+ * Push our precommit (paxos 2a in term {1, 0}) straight to repliers of the
+ * cohort instead of waiting until walsenders decode it and apply workers get
+ * through whatever is queued before it. Replier answers only if it actually
+ * accepted the decree; otherwise (e.g. apply worker still holds the gtx) the
+ * answer comes from the WAL path as before, so the latter remains the one
+ * which guarantees delivery.
+ */
+static void
+MtmSendDirectPrecommit(nodemask_t cohort, uint64 gen_num)
+{
+	MtmTxRequest msg;
+	StringInfo	packed_msg;
+	int			i;
+
+	msg.tag = T_MtmTxRequest;
+	msg.type = MTReq_Precommit;
+	msg.term = InitialGTxTerm;
+	msg.gid = mtm_commit_state.gid;
+	msg.coordinator = mtm_cfg->my_node_id;
+	msg.gen_num = gen_num;
+	msg.coordinator_end_lsn = InvalidXLogRecPtr;
+	packed_msg = MtmMessagePack((MtmMessage *) &msg);
+
+	for (i = 0; i < MTM_MAX_NODES; i++)
+	{
+		DmqDestinationId dest_id;
+
+		if (!BIT_CHECK(cohort, i))
+			continue;
+
+		LWLockAcquire(Mtm->lock, LW_SHARED);
+		dest_id = Mtm->peers[i].dmq_dest_id;
+		LWLockRelease(Mtm->lock);
+
+		if (dest_id >= 0)
+			dmq_push_buffer(dest_id, "reqresp", packed_msg->data,
+							packed_msg->len);
+	}
+	pfree(packed_msg->data);
+	pfree(packed_msg);
+}
+
+/*
+ * Wait for commit acks of mtm_commit_state.gid. Failure to get them is not
+ * a reason to ERROR as xact is already committed, so only warn.
+ */
+static void
+MtmGatherCommitAcks(nodemask_t cohort, uint64 gen_num)
+{
+	Mtm2AResponse *twoa_messages[MTM_MAX_NODES];
+	int			n_messages;
+	int			i;
+	bool		ret;
+
+	/* abusing message type is slightly dubious */
+	ret = gather(cohort,
+				 (MtmMessage **) twoa_messages, NULL, &n_messages,
+				 CommitAckGatherHook, PointerGetDatum(mtm_commit_state.gid),
+				 NULL, gen_num);
+
+	if (!ret)
+	{
+		MtmGeneration new_gen = MtmGetCurrentGen(false);
+		ereport(WARNING,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("[MTM] failed to collect commit acks of transaction %s due to generation switch: was num=" UINT64_FORMAT ", now num=" UINT64_FORMAT ", members=%s",
+						mtm_commit_state.gid,
+						gen_num,
+						new_gen.num,
+						maskToString(new_gen.members))));
+	}
+	else if (n_messages != popcount(cohort))
+	{
+		nodemask_t failed_cohort = cohort;
+		for (i = 0; i < n_messages; i++)
+		{
+			BIT_CLEAR(failed_cohort, twoa_messages[i]->node_id - 1);
+		}
+		ereport(WARNING,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("[MTM] failed to collect commit acks of transaction %s at nodes %s due to network error",
+						mtm_commit_state.gid,
+						maskToString(failed_cohort))));
+	}
+}
+
+/*
+ * Collect commit acks of the previous xact postponed by
+ * MtmPipelineCommitAcks, if any.
+ */
+static void
+MtmWaitPendingCommitAcks(void)
+{
+	MemoryContext oldcontext;
+
+	if (!mtm_commit_state.acks_pending)
+		return;
+	mtm_commit_state.acks_pending = false;
+
+	/* nobody is going to look at the session's results anymore */
+	if (proc_exit_inprogress)
+	{
+		dmq_stream_unsubscribe();
+		return;
+	}
+
+	oldcontext = MemoryContextSwitchTo(mtm_commit_state.mctx);
+	PG_TRY();
+	{
+		MtmGatherCommitAcks(mtm_commit_state.acks_cohort,
+							mtm_commit_state.acks_gen_num);
+	}
+	PG_CATCH();
+	{
+		dmq_stream_unsubscribe();
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	dmq_stream_unsubscribe();
+	mtm_log(MtmCoordinatorTrace, "%s collected pipelined commit acks",
+			mtm_commit_state.gid);
+	MemoryContextSwitchTo(oldcontext);
+	MemoryContextReset(mtm_commit_state.mctx);
+}
+
+/*
+ * Precommit round exists to let others finish the xact if the coordinator
+ * fails after PREPARE; without it only the coordinator knows whether it has
+ * already committed, and resolver won't decide on such xact until the
+ * coordinator votes (or it learns the outcome from somebody). Stalling
+ * resolution of in-doubt xacts until the failed coordinator is back is a
+ * fair price for the round trip when failures are unlikely, so with
+ * MtmAdaptiveCommit skip the round while all configured nodes are members of
+ * the generation and connected to us.
+ */
+static bool
+MtmCanSkipPrecommit(MtmGeneration *gen)
+{
+	nodemask_t	connected;
+
+	if (!MtmAdaptiveCommit)
+		return false;
+	/* precommit is skipped when working alone anyway */
+	if (IS_REFEREE_GEN(gen->members, gen->configured))
+		return false;
+	if (gen->members != gen->configured)
+		return false;
+
+	connected = MtmGetConnectedMaskWithMe(false);
+	return (connected & gen->members) == gen->members;
+}
 
 /*
  * Returns false if mtm is not interested in this xact at all.
@@ -389,6 +622,14 @@ MtmTwoPhaseCommit(void)
 	if (!MtmTx.distributed)
 		return false;
 
+	/*
+	 * DML which didn't change anything (e.g. UPDATE matched no rows) leaves
+	 * the xact without xid and hence nothing to replicate; don't assign one
+	 * just to PREPARE an empty xact everywhere.
+	 */
+	if (!TransactionIdIsValid(GetTopTransactionIdIfAny()))
+		return false;
+
 	/*
 	 * If this is implicit single-query xact, wrap it in block to execute
 	 * PREPARE.
@@ -439,6 +680,7 @@ MtmTwoPhaseCommit(void)
 
 		xact_gen = MtmGetCurrentGen(true);
 		xid = GetTopTransactionId();
+		Assert(!mtm_commit_state.acks_pending);
 		MtmGenerateGid(mtm_commit_state.gid, mtm_cfg->my_node_id, xid,
 					   xact_gen.num);
 		sprintf(dmq_stream_name, "xid" XID_FMT, xid);
@@ -447,8 +689,7 @@ MtmTwoPhaseCommit(void)
 				mtm_commit_state.gid, dmq_stream_name);
 
 		/* prepare transaction on our node */
-		mtm_commit_state.gtx = GlobalTxAcquire(mtm_commit_state.gid, true,
-											   false, NULL, 0);
+		mtm_commit_state.gtx = GlobalTxAcquireLocal(mtm_commit_state.gid);
 		/*
 		 * it is simpler to mark gtx originated here as orphaned from the
 		 * beginning rather than in error handler; resolver won't touch gtx
@@ -459,6 +700,8 @@ MtmTwoPhaseCommit(void)
 		mtm_commit_state.gtx->xinfo.xid = xid;
 		mtm_commit_state.gtx->xinfo.gen_num = xact_gen.num;
 		mtm_commit_state.gtx->xinfo.configured = xact_gen.configured;
+		mtm_commit_state.gtx->xinfo.skip_precommit =
+			MtmCanSkipPrecommit(&xact_gen);
 		Assert(mtm_commit_state.gtx->state.status == GTXInvalid);
 		/*
 		 * PREPARE doesn't happen here; ret 0 just means we were already in
@@ -567,6 +810,17 @@ MtmTwoPhaseCommit(void)
 			}
 		}
 
+		/*
+		 * Everyone prepared and nobody can decide the outcome without us,
+		 * so just commit; c.f. MtmCanSkipPrecommit.
+		 */
+		if (mtm_commit_state.gtx->xinfo.skip_precommit)
+		{
+			pc_success_cohort = cohort;
+			mtm_log(MtmTxTrace, "%s skipped precommit", mtm_commit_state.gid);
+			goto precommit_tour_done;
+		}
+
 		/* ok, we have all prepare responses, precommit */
 		gtx_state.status = GTXPreCommitted;
 		gtx_state.proposal = InitialGTxTerm;
@@ -590,6 +844,8 @@ MtmTwoPhaseCommit(void)
 		pc_success_cohort = 0;
 		if (IS_REFEREE_GEN(xact_gen.members, xact_gen.configured))
 			goto precommit_tour_done;
+		if (MtmDirectPrecommit)
+			MtmSendDirectPrecommit(cohort, xact_gen.num);
 		/*
 		 * Here (paxos 2a/2b) we need only majority of acks, probably it'd be
 		 * useful to teach gather return once quorum of good msgs collected.
@@ -659,47 +915,29 @@ precommit_tour_done:
 		mtm_commit_state.gtx = NULL;
 
 		/*
-		 * Optionally wait for commit ack
+		 * Optionally wait for commit ack, now or at the start of the next
+		 * xact in this session: the client can't get anything from us
+		 * before that anyway, so we overlap the round trip with its think
+		 * time.
 		 */
 		if (!MtmWaitPeerCommits)
 			goto commit_tour_done;
-
-		/* abusing both message type and gather hook is slightly dubious */
-		ret = gather(pc_success_cohort,
-					 (MtmMessage **) twoa_messages, NULL, &n_messages,
-					 Paxos2AGatherHook, PointerGetDatum(mtm_commit_state.gid),
-					 NULL, xact_gen.num);
-
-		if (!ret)
+		if (MtmPipelineCommitAcks && pc_success_cohort != 0)
 		{
-			MtmGeneration new_gen = MtmGetCurrentGen(false);
-			ereport(WARNING,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("[MTM] failed to collect commit acks of transaction %s due to generation switch: was num=" UINT64_FORMAT ", members=%s, now num=" UINT64_FORMAT ", members=%s",
-							mtm_commit_state.gid,
-							xact_gen.num,
-							maskToString(xact_gen.members),
-							new_gen.num,
-							maskToString(new_gen.members))));
-		}
-		else if (n_messages != popcount(pc_success_cohort))
-		{
-			nodemask_t failed_cohort = pc_success_cohort;
-			for (i = 0; i < n_messages; i++)
-			{
-				BIT_CLEAR(failed_cohort, twoa_messages[i]->node_id - 1);
-			}
-			ereport(WARNING,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("[MTM] failed to collect commit acks of transaction %s at nodes %s due to network error",
-							mtm_commit_state.gid,
-							maskToString(failed_cohort))));
+			mtm_commit_state.acks_pending = true;
+			mtm_commit_state.acks_cohort = pc_success_cohort;
+			mtm_commit_state.acks_gen_num = xact_gen.num;
 		}
+		else
+			MtmGatherCommitAcks(pc_success_cohort, xact_gen.num);
 
 commit_tour_done:
-		dmq_stream_unsubscribe();
-		mtm_log(MtmCoordinatorTrace, "%s unsubscribed for %s",
-				mtm_commit_state.gid, dmq_stream_name);
+		if (!mtm_commit_state.acks_pending)
+		{
+			dmq_stream_unsubscribe();
+			mtm_log(MtmCoordinatorTrace, "%s unsubscribed for %s",
+					mtm_commit_state.gid, dmq_stream_name);
+		}
 		mtm_commit_state.inside_commit_sequence = false;
 		/*
 		 * If MtmTwoPhaseCommit happened in COMMIT's ProcessUtility hook,
@@ -818,6 +1056,7 @@ MtmExplicitPrepare(char *gid)
 		mtm_commit_state.gtx->xinfo.xid = xid;
 		mtm_commit_state.gtx->xinfo.gen_num = xact_gen.num;
 		mtm_commit_state.gtx->xinfo.configured = xact_gen.configured;
+		mtm_commit_state.gtx->xinfo.skip_precommit = false;
 		Assert(mtm_commit_state.gtx->state.status == GTXInvalid);
 
 		sprintf(stream, "xid" XID_FMT, xid);
@@ -33,6 +33,7 @@
 #include "nodes/nodeFuncs.h"
 #include "catalog/pg_constraint.h"
 #include "catalog/pg_namespace.h"
+#include "catalog/pg_sequence.h"
 #include "executor/spi.h"
 #include "utils/lsyscache.h"
 #include "catalog/indexing.h"
@@ -62,6 +63,7 @@
 #define GUC_KEY_MAXLEN					255
 #define MTM_GUC_HASHSIZE				100
 #define MULTIMASTER_MAX_LOCAL_TABLES	256
+#define MTM_LOCAL_TABLES_CACHE_SIZE		256
 
 #define Natts_mtm_local_tables 2
 #define Anum_mtm_local_tables_rel_schema 1
@@ -70,6 +72,8 @@
 struct DDLSharedState
 {
 	LWLock	   *localtab_lock;
+	/* bumped on each change of MtmLocalTables, see MtmIsRelationLocal */
+	pg_atomic_uint64 localtab_generation;
 }		   *ddl_shared;
 
 typedef struct MtmGucEntry
@@ -87,6 +91,7 @@ typedef struct
 /* GUCs */
 bool		MtmVolksWagenMode;
 bool		MtmMonotonicSequences;
+int			MtmSequenceBlockSize;
 char	   *MtmRemoteFunctionsList;
 bool		MtmIgnoreTablesWithoutPk;
 
@@ -106,6 +111,16 @@ static HTAB *MtmRemoteFunctions;
 static bool MtmRemoteFunctionsValid;
 static HTAB *MtmLocalTables;
 
+/* backend-local copy of MtmLocalTables lookups */
+typedef struct
+{
+	Oid			relid;
+	bool		is_local;
+} MtmLocalTablesCacheEntry;
+
+static HTAB *MtmLocalTablesCache;
+static uint64 MtmLocalTablesCacheGeneration;
+
 static ExecutorStart_hook_type PreviousExecutorStartHook;
 static ExecutorFinish_hook_type PreviousExecutorFinishHook;
 static ProcessUtility_hook_type PreviousProcessUtilityHook;
@@ -199,6 +214,8 @@ MtmDDLReplicationShmemStartup(void)
 	if (!found)
 	{
 		ddl_shared->localtab_lock = &(GetNamedLWLockTranche("mtm-ddl"))->lock;
+		/* start with 1, so that zeroed backend cache is never valid */
+		pg_atomic_init_u64(&ddl_shared->localtab_generation, 1);
 	}
 
 	MtmLocalTables = ShmemInitHash("MtmLocalTables",
@@ -1155,7 +1172,7 @@ MtmProcessUtilitySender(PlannedStmt *pstmt, const char *queryString,
 						{
 							Relation	rel = table_open(relid, ShareLock);
 
-							if (RelationNeedsWAL(rel))
+							if (RelationNeedsWAL(rel) && !MtmIsRelationLocal(rel))
 								MtmTx.contains_dml = true;
 
 							table_close(rel, ShareLock);
@@ -1592,6 +1609,7 @@ MtmMakeRelationLocal(Oid relid, bool locked)
 		if (!locked)
 			LWLockAcquire(ddl_shared->localtab_lock, LW_EXCLUSIVE);
 		hash_search(MtmLocalTables, &relid, HASH_ENTER, NULL);
+		pg_atomic_fetch_add_u64(&ddl_shared->localtab_generation, 1);
 		if (!locked)
 			LWLockRelease(ddl_shared->localtab_lock);
 	}
@@ -1635,11 +1653,41 @@ MtmLoadLocalTables(void)
 	}
 }
 
+/*
+ * Walsenders call this for every decoded change, so avoid going to shared
+ * hash each time: remember answers locally until somebody changes the set
+ * of local tables.
+ */
 bool
 MtmIsRelationLocal(Relation rel)
 {
+	Oid			relid = RelationGetRelid(rel);
+	uint64		generation;
+	MtmLocalTablesCacheEntry *entry;
 	bool		found;
 
+	generation = pg_atomic_read_u64(&ddl_shared->localtab_generation);
+	if (MtmLocalTablesCache == NULL ||
+		MtmLocalTablesCacheGeneration != generation)
+	{
+		HASHCTL		ctl;
+
+		if (MtmLocalTablesCache != NULL)
+			hash_destroy(MtmLocalTablesCache);
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(MtmLocalTablesCacheEntry);
+		MtmLocalTablesCache = hash_create("MtmLocalTablesCache",
+										  MTM_LOCAL_TABLES_CACHE_SIZE, &ctl,
+										  HASH_ELEM | HASH_BLOBS);
+		MtmLocalTablesCacheGeneration = generation;
+	}
+
+	entry = hash_search(MtmLocalTablesCache, &relid, HASH_FIND, NULL);
+	if (entry != NULL)
+		return entry->is_local;
+
 	LWLockAcquire(ddl_shared->localtab_lock, LW_SHARED);
 	if (!Mtm->localTablesHashLoaded)
 	{
@@ -1652,9 +1700,16 @@ MtmIsRelationLocal(Relation rel)
 		}
 	}
 
-	hash_search(MtmLocalTables, &RelationGetRelid(rel), HASH_FIND, &found);
+	hash_search(MtmLocalTables, &relid, HASH_FIND, &found);
 	LWLockRelease(ddl_shared->localtab_lock);
 
+	/*
+	 * Remember the answer under the generation we have read before looking
+	 * it up: if the set has changed in between, the next call will notice.
+	 */
+	entry = hash_search(MtmLocalTablesCache, &relid, HASH_ENTER, NULL);
+	entry->is_local = found;
+
 	return found;
 }
 
@@ -1740,6 +1795,64 @@ MtmInitializeRemoteFunctionsMap()
  *
  *****************************************************************************/
 
+/*
+ * With MtmSequenceBlockSize, ascending sequence values are split into blocks
+ * of that size. Values of different nodes in a block are disjoint due to
+ * increment/start set in AdjustCreateSequence, so every node has its own
+ * share of each block. A node announces the block only when it takes its
+ * first value in it, and the announced position is the start of the block:
+ * peers move into the block and go on with their shares of it rather than
+ * skip it, so their own first values there announce nothing new and nodes
+ * writing concurrently don't push each other into ever new blocks. This
+ * coarsens monotonicity to the block.
+ *
+ * Sessions usually draw from one sequence in a row, so increment of the last
+ * one is cached to avoid syscache lookup on each nextval.
+ */
+static Oid	seq_cache_id = InvalidOid;
+static int64 seq_cache_increment;
+
+static void
+seq_cache_cb(Datum arg, int cacheid, uint32 hashvalue)
+{
+	seq_cache_id = InvalidOid;
+}
+
+static bool
+MtmSeqBlockStarted(Oid seqid, int64 next, int64 *block_start)
+{
+	static bool cb_registered = false;
+	int64		block = MtmSequenceBlockSize;
+
+	if (seqid != seq_cache_id)
+	{
+		HeapTuple	tuple;
+
+		if (!cb_registered)
+		{
+			CacheRegisterSyscacheCallback(SEQRELID, seq_cache_cb, (Datum) 0);
+			cb_registered = true;
+		}
+
+		tuple = SearchSysCache1(SEQRELID, ObjectIdGetDatum(seqid));
+		if (!HeapTupleIsValid(tuple))
+			elog(ERROR, "cache lookup failed for sequence %u", seqid);
+		seq_cache_increment = ((Form_pg_sequence) GETSTRUCT(tuple))->seqincrement;
+		ReleaseSysCache(tuple);
+		seq_cache_id = seqid;
+	}
+
+	/* keep it simple, descending and non-positive ones go value by value */
+	if (seq_cache_increment <= 0 || next <= 0)
+	{
+		*block_start = next;
+		return true;
+	}
+
+	*block_start = next - next % block;
+	return next - seq_cache_increment < *block_start;
+}
+
 static void
 MtmSeqNextvalHook(Oid seqid, int64 next)
 {
@@ -1749,6 +1862,9 @@ MtmSeqNextvalHook(Oid seqid, int64 next)
 
 		pos.seqid = seqid;
 		pos.next = next;
+		if (MtmSequenceBlockSize > 0 &&
+			!MtmSeqBlockStarted(seqid, next, &pos.next))
+			return;
 		LogLogicalMessage("N", (char *) &pos, sizeof(pos), true);
 	}
 }
@@ -56,6 +56,13 @@
 #define DMQ_MQ_SIZE  ((Size) 65536)
 #define DMQ_MQ_MAGIC 0x646d71
 
+/*
+ * Sender packs messages to the same destination which it found in backend
+ * queues during one pass into one frame of stream "B" (see dmq_batch_add), up
+ * to this many bytes.
+ */
+#define DMQ_BATCH_MAX_LEN 8192
+
 /*
  * Shared data structures to hold current connections topology.
  * All that stuff can be moved to persistent tables to avoid hardcoded
@@ -238,6 +245,10 @@ typedef struct
 /* Flags set by signal handlers */
 static volatile sig_atomic_t got_SIGHUP = false;
 
+/* sender stats, reported at exit */
+static uint64 dmq_sent_messages = 0;
+static uint64 dmq_sent_frames = 0;
+
 static shmem_startup_hook_type PreviousShmemStartupHook;
 
 void *(*dmq_receiver_start_hook)(char *sender_name);
@@ -473,11 +484,74 @@ dmq_send(DmqDestination *conns, int conn_id, char *data, size_t len)
 	}
 }
 
+/*
+ * Batch of messages to one destination: "B" stream name followed by
+ * (int32 length, message) pairs, where message is what backend has pushed,
+ * i.e. stream name and body. A batch with single message is sent as is.
+ */
+typedef struct
+{
+	StringInfoData buf;
+	int			n_messages;
+	int			first_len;
+} DmqBatch;
+
+static void
+dmq_batch_flush(DmqDestination *conns, int conn_id, DmqBatch *batch)
+{
+	if (batch->n_messages == 0)
+		return;
+
+	if (conns[conn_id].state != Active)
+	{
+		/* previous frame failed */
+		mtm_log(WARNING,
+				"[DMQ] dropping %d messages to disconnected %s",
+				batch->n_messages, conns[conn_id].receiver_name);
+	}
+	else if (batch->n_messages == 1)
+		dmq_send(conns, conn_id, batch->buf.data + 2 + 4, batch->first_len);
+	else
+		dmq_send(conns, conn_id, batch->buf.data, batch->buf.len);
+
+	if (conns[conn_id].state == Active)
+	{
+		dmq_sent_messages += batch->n_messages;
+		dmq_sent_frames++;
+	}
+
+	resetStringInfo(&batch->buf);
+	batch->n_messages = 0;
+}
+
+static void
+dmq_batch_add(DmqDestination *conns, int conn_id, DmqBatch *batch,
+			  char *data, size_t len)
+{
+	if (batch->n_messages > 0 &&
+		batch->buf.len + 4 + len > DMQ_BATCH_MAX_LEN)
+		dmq_batch_flush(conns, conn_id, batch);
+
+	if (batch->n_messages == 0)
+	{
+		/* stream name is cstring by convention */
+		appendStringInfoChar(&batch->buf, 'B');
+		appendStringInfoChar(&batch->buf, '\0');
+		batch->first_len = len;
+	}
+	pq_sendint32(&batch->buf, len);
+	appendBinaryStringInfo(&batch->buf, data, len);
+	batch->n_messages++;
+}
+
 static void
 dmq_sender_at_exit(int status, Datum arg)
 {
 	int			i;
 
+	mtm_log(DmqStateFinal, "[DMQ] sent " UINT64_FORMAT " messages in " UINT64_FORMAT " frames",
+			dmq_sent_messages, dmq_sent_frames);
+
 	LWLockAcquire(dmq_state->lock, LW_SHARED);
 	for (i = 0; i < DMQ_MAX_RECEIVERS; i++)
 	{
@@ -505,6 +579,7 @@ dmq_sender_main(Datum main_arg)
 	shm_mq_handle **mq_handles;
 	WaitEventSet *set;
 	DmqDestination conns[DMQ_MAX_DESTINATIONS];
+	DmqBatch	batches[DMQ_MAX_DESTINATIONS];
 	int			heartbeat_send_timeout;
 	int			connect_timeout;
 	StringInfoData heartbeat_buf; /* heartbeat data is accumulated here */
@@ -549,6 +624,8 @@ dmq_sender_main(Datum main_arg)
 	for (i = 0; i < DMQ_MAX_DESTINATIONS; i++)
 	{
 		conns[i].active = false;
+		initStringInfo(&batches[i].buf);
+		batches[i].n_messages = 0;
 	}
 
 	LWLockAcquire(dmq_state->lock, LW_EXCLUSIVE);
@@ -641,7 +718,7 @@ dmq_sender_main(Datum main_arg)
 
 				if (conns[conn_id].state == Active)
 				{
-					dmq_send(conns, conn_id, data, len);
+					dmq_batch_add(conns, conn_id, &batches[conn_id], data, len);
 				}
 				else
 				{
@@ -670,6 +747,13 @@ dmq_sender_main(Datum main_arg)
 			}
 		}
 
+		/*
+		 * E.g. apply workers acking different xacts of the same coordinator
+		 * often have something to send at once; ship it in one frame.
+		 */
+		for (i = 0; i < DMQ_MAX_DESTINATIONS; i++)
+			dmq_batch_flush(conns, i, &batches[i]);
+
 		/*
 		 * Generate timeout or socket events.
 		 *
@@ -1056,6 +1140,31 @@ dmq_handle_message(StringInfo msg, DmqReceiverSlot *my_slot,
 		return;
 	}
 
+	/*
+	 * Stream name "B" is reserved for batches of messages, see
+	 * dmq_batch_add.
+	 */
+	if (strcmp(stream_name, "B") == 0)
+	{
+		StringInfoData batch;
+
+		batch.data = (char *) body;
+		batch.len = body_len;
+		batch.maxlen = -1;
+		batch.cursor = 0;
+		while (batch.cursor < batch.len)
+		{
+			StringInfoData one;
+
+			one.len = pq_getmsgint(&batch, 4);
+			one.data = (char *) pq_getmsgbytes(&batch, one.len);
+			one.maxlen = -1;
+			one.cursor = 0;
+			dmq_handle_message(&one, my_slot, segs, mq_handles, extra);
+		}
+		return;
+	}
+
 	/*
 	 * Find subscriber. XXX: we can cache that and re-read shared memory upon
 	 * a signal, but likely that won't show any measurable speedup.
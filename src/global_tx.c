@@ -19,25 +19,108 @@
 
 #include "postgres.h"
 
+/* mkdir, unlink */
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "access/twophase.h"
 #include "catalog/pg_authid.h"
 #include "catalog/pg_type.h"
 #include "executor/spi.h"
+#include "port/pg_crc32c.h"
+#include "postmaster/autovacuum.h"
+#include "replication/walsender.h"
+#include "storage/fd.h"
 #include "storage/ipc.h"
+#include "storage/spin.h"
 #include "utils/lsyscache.h"
 #include "utils/pg_lsn.h"
 #include "utils/snapmgr.h"
 #include "utils/hsearch.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 
 #include "global_tx.h"
 #include "commit.h"
 #include "logger.h"
+#include "resolver.h"
 
 gtx_shared_data *gtx_shared;
 static GlobalTx *my_locked_gtx;
 static bool gtx_exit_registered;
 
+/*
+ * Outcome index: final status of recently finished multimaster xacts. Once
+ * gtx is finished and removed from gid2gtx, replier otherwise can learn its
+ * outcome only by scanning WAL, which is slow, while status requests
+ * mostly ask about xacts finished just now.
+ *
+ * Keys are binary gids, so only xacts with gids generated by multimaster
+ * get here: user gid of explicit 2PC may be reused for another xact.
+ * Each partition keeps a ring of its keys in insertion order and evicts
+ * the oldest one when full. The index lives in shmem and is saved to disk
+ * on clean shutdown; after crash we start empty and fall back to WAL scan.
+ * Outcomes never change, so stale entries are harmless.
+ */
+#define GTX_OUTCOMES_PER_PARTITION 4096
+#define GTX_OUTCOMES_FILE "pg_mtm/gtx_outcomes"
+#define GTX_OUTCOMES_MAGIC 0x6F757463
+#define GTX_OUTCOMES_VERSION 1
+
+typedef struct
+{
+	MtmGid		key;
+	GlobalTxStatus status;
+} GlobalTxOutcome;
+
+typedef struct GlobalTxOutcomeRing
+{
+	int			next;			/* slot to fill next */
+	MtmGid		slots[GTX_OUTCOMES_PER_PARTITION]; /* node_id 0 if empty */
+} GlobalTxOutcomeRing;
+
+/*
+ * Coordinator gtx of each backend lives in its own preallocated slot rather
+ * than in gid2gtx: a backend coordinates at most one xact at a time, and
+ * inserting/removing hash entry under exclusive partition lock twice per
+ * commit is a waste. Nobody but the owner ever acquires gtx in a slot, so
+ * others only need to learn that it exists (and wait for its release); for
+ * that occupied slots are linked into small chained hash table keyed by xid
+ * of the xact, which is encoded in the gid and is unique among running
+ * xacts. Each bucket is protected by its own spinlock; link fields and the
+ * key of a slot change only under it.
+ *
+ * If the owner releases gtx with unknown outcome, it is moved into gid2gtx
+ * for resolver. Should that fail for lack of shmem, the slot stays linked
+ * and stuck: the owner doesn't touch it anymore, and whoever first moves it
+ * (the owner on exit or before reusing the slot, or resolver which checks
+ * stuck slots each round, see GlobalTxMigrateStuck) does so under the
+ * partition lock of the gtx.
+ */
+typedef struct GlobalTxSlot
+{
+	TransactionId xid;			/* InvalidTransactionId if not linked */
+	uint64		gen_num;
+	int			next;			/* next slot in the bucket or -1 */
+	bool		stuck;			/* waits to be moved into gid2gtx */
+	GlobalTx	gtx;
+} GlobalTxSlot;
+
+typedef struct GlobalTxSlotBucket
+{
+	slock_t		mutex;
+	int			head;			/* first slot or -1 */
+} GlobalTxSlotBucket;
+
+static GlobalTxSlot *my_gtx_slot;
+
+static bool gtx_slot_migrate(GlobalTxSlot *slot, uint32 hashcode, bool stuck,
+							 bool missing_ok);
+
+static void GlobalTxRememberOutcome(const char *gid, GlobalTxStatus status);
+static void GlobalTxOutcomesLoad(void);
+static void GlobalTxOutcomesSave(int code, Datum arg);
+
 char const *const GlobalTxStatusMnem[] =
 {
 	"GTXInvalid",
@@ -67,37 +150,156 @@ term_cmp(GlobalTxTerm t1, GlobalTxTerm t2)
 		return 1;
 }
 
-#define XStateVersion 1
+#define XStateVersion 2
 
-char *
-serialize_xstate(XactInfo *xinfo, GTxState *gtx_state)
+/*
+ * state_3pc is kept by core as C string (in 2PC state file and WAL) and is
+ * shipped with pq_sendstring, so it must stay text. Its layout is
+ *
+ *   version-coordinator-xid-GEN-CONFIGURED-status-pb:pn-ab:an-skip
+ *
+ * with gen_num and configured mask in upper-case hex and everything else in
+ * decimal (version 1 had no trailing skip_precommit flag). It is
+ * (de)serialized on each PREPARE, precommit and vote, so both directions are
+ * done by hand below instead of psprintf/sscanf.
+ */
+#define XSTATE_MAX_LEN 128
+
+static const char *const xstate_status_abbr[] = {
+	"in",						/* GTXInvalid */
+	"pc",						/* GTXPreCommitted */
+	"pa",						/* GTXPreAborted */
+	"cm",						/* GTXCommitted */
+	"ab"						/* GTXAborted */
+};
+
+static char *
+xstate_put_dec(char *p, int64 val)
 {
-	char	   *state;
-	char	   *status_abbr;
-
-	if (gtx_state->status == GTXInvalid)
-		status_abbr = "in";
-	else if (gtx_state->status == GTXPreCommitted)
-		status_abbr = "pc";
-	else if (gtx_state->status == GTXPreAborted)
-		status_abbr = "pa";
-	else if (gtx_state->status == GTXCommitted)
-		status_abbr = "cm";
-	else
+	char		buf[24];
+	char	   *b = buf + sizeof(buf);
+	uint64		uval = val < 0 ? -(uint64) val : (uint64) val;
+
+	do
+	{
+		*--b = '0' + uval % 10;
+		uval /= 10;
+	} while (uval != 0);
+	if (val < 0)
+		*--b = '-';
+
+	memcpy(p, b, buf + sizeof(buf) - b);
+	return p + (buf + sizeof(buf) - b);
+}
+
+static char *
+xstate_put_hex(char *p, uint64 val)
+{
+	static const char hexdigits[] = "0123456789ABCDEF";
+	char		buf[16];
+	char	   *b = buf + sizeof(buf);
+
+	do
+	{
+		*--b = hexdigits[val & 0xF];
+		val >>= 4;
+	} while (val != 0);
+
+	memcpy(p, b, buf + sizeof(buf) - b);
+	return p + (buf + sizeof(buf) - b);
+}
+
+static bool
+xstate_get_dec(const char **p, int64 *val)
+{
+	const char *c = *p;
+	bool		neg = false;
+	uint64		v = 0;
+
+	if (*c == '-')
 	{
-		Assert(gtx_state->status == GTXAborted);
-		status_abbr = "ab";
+		neg = true;
+		c++;
 	}
+	if (*c < '0' || *c > '9')
+		return false;
+	while (*c >= '0' && *c <= '9')
+		v = v * 10 + (*c++ - '0');
+
+	*val = neg ? -(int64) v : (int64) v;
+	*p = c;
+	return true;
+}
+
+static bool
+xstate_get_hex(const char **p, uint64 *val)
+{
+	const char *c = *p;
+	uint64		v = 0;
+	int			digit;
 
-	state = psprintf("%d-%d-" XID_FMT "-%" INT64_MODIFIER "X-%" INT64_MODIFIER "X-%s-%d:%d-%d:%d",
-					 XStateVersion,
-					 xinfo->coordinator,
-					 xinfo->xid,
-					 xinfo->gen_num,
-					 xinfo->configured,
-					 status_abbr,
-					 gtx_state->proposal.ballot, gtx_state->proposal.node_id,
-					 gtx_state->accepted.ballot, gtx_state->accepted.node_id);
+	for (;; c++)
+	{
+		if (*c >= '0' && *c <= '9')
+			digit = *c - '0';
+		else if (*c >= 'A' && *c <= 'F')
+			digit = *c - 'A' + 10;
+		else if (*c >= 'a' && *c <= 'f')
+			digit = *c - 'a' + 10;
+		else
+			break;
+		v = (v << 4) | digit;
+	}
+	if (c == *p)
+		return false;
+
+	*val = v;
+	*p = c;
+	return true;
+}
+
+static inline bool
+xstate_skip(const char **p, char sep)
+{
+	if (**p != sep)
+		return false;
+	(*p)++;
+	return true;
+}
+
+char *
+serialize_xstate(XactInfo *xinfo, GTxState *gtx_state)
+{
+	char	   *state = palloc(XSTATE_MAX_LEN);
+	char	   *p = state;
+
+	Assert(gtx_state->status >= GTXInvalid && gtx_state->status <= GTXAborted);
+
+	p = xstate_put_dec(p, XStateVersion);
+	*p++ = '-';
+	p = xstate_put_dec(p, xinfo->coordinator);
+	*p++ = '-';
+	p = xstate_put_dec(p, xinfo->xid);
+	*p++ = '-';
+	p = xstate_put_hex(p, xinfo->gen_num);
+	*p++ = '-';
+	p = xstate_put_hex(p, xinfo->configured);
+	*p++ = '-';
+	memcpy(p, xstate_status_abbr[gtx_state->status], 2);
+	p += 2;
+	*p++ = '-';
+	p = xstate_put_dec(p, gtx_state->proposal.ballot);
+	*p++ = ':';
+	p = xstate_put_dec(p, gtx_state->proposal.node_id);
+	*p++ = '-';
+	p = xstate_put_dec(p, gtx_state->accepted.ballot);
+	*p++ = ':';
+	p = xstate_put_dec(p, gtx_state->accepted.node_id);
+	*p++ = '-';
+	p = xstate_put_dec(p, xinfo->skip_precommit ? 1 : 0);
+	*p = '\0';
+
+	Assert(p - state < XSTATE_MAX_LEN);
 	return state;
 }
 
@@ -106,42 +308,74 @@ int
 deserialize_xstate(const char *state, XactInfo *xinfo, GTxState *gtx_state,
 				   int elevel)
 {
+	const char *p = state;
 	int			n_parsed = 0;
-	char		status_abbr[3]; /* must be big enough for '\0' */
+	int64		version;
+	int64		coordinator;
+	int64		xid;
+	int64		terms[4];
+	int64		skip_precommit = 0;
+	int			status;
+	int			i;
 
 	Assert(state);
 
-	n_parsed = sscanf(state, "%*d-%d-" XID_FMT "-%" INT64_MODIFIER "X-%" INT64_MODIFIER "X-%2s-%d:%d-%d:%d",
-					  &xinfo->coordinator,
-					  &xinfo->xid,
-					  &xinfo->gen_num,
-					  &xinfo->configured,
-					  status_abbr,
-					  &gtx_state->proposal.ballot,
-					  &gtx_state->proposal.node_id,
-					  &gtx_state->accepted.ballot,
-					  &gtx_state->accepted.node_id);
-	if (n_parsed != 9)
-	{
-		mtm_log(elevel, "GlobalTxLoadAll: failed to deparse state_3pc %s, ignoring it (res=%d)",
-				state, n_parsed);
-		return n_parsed;
-	}
-
-	if (strncmp(status_abbr, "in", 2) == 0)
-		gtx_state->status = GTXInvalid;
-	else if (strncmp(status_abbr, "pc", 2) == 0)
-		gtx_state->status = GTXPreCommitted;
-	else if (strncmp(status_abbr, "pa", 2) == 0)
-		gtx_state->status = GTXPreAborted;
-	else if (strncmp(status_abbr, "cm", 3) == 0)
-		gtx_state->status = GTXCommitted;
-	else
+	if (!xstate_get_dec(&p, &version) || !xstate_skip(&p, '-'))
+		goto bad;
+	if (!xstate_get_dec(&p, &coordinator) || !xstate_skip(&p, '-'))
+		goto bad;
+	n_parsed++;
+	if (!xstate_get_dec(&p, &xid) || !xstate_skip(&p, '-'))
+		goto bad;
+	n_parsed++;
+	if (!xstate_get_hex(&p, &xinfo->gen_num) || !xstate_skip(&p, '-'))
+		goto bad;
+	n_parsed++;
+	if (!xstate_get_hex(&p, &xinfo->configured) || !xstate_skip(&p, '-'))
+		goto bad;
+	n_parsed++;
+
+	for (status = GTXInvalid; status <= GTXAborted; status++)
+	{
+		if (strncmp(p, xstate_status_abbr[status], 2) == 0)
+			break;
+	}
+	if (status > GTXAborted)
+		goto bad;
+	p += 2;
+	if (!xstate_skip(&p, '-'))
+		goto bad;
+	n_parsed++;
+
+	for (i = 0; i < 4; i++)
 	{
-		Assert((strncmp(status_abbr, "ab", 2) == 0));
-		gtx_state->status = GTXAborted;
+		if (!xstate_get_dec(&p, &terms[i]))
+			goto bad;
+		if (i < 3 && !xstate_skip(&p, i % 2 == 0 ? ':' : '-'))
+			goto bad;
+		n_parsed++;
 	}
+	if (version >= 2)
+	{
+		if (!xstate_skip(&p, '-') || !xstate_get_dec(&p, &skip_precommit))
+			goto bad;
+		n_parsed++;
+	}
+
+	xinfo->coordinator = (int) coordinator;
+	xinfo->xid = (TransactionId) xid;
+	xinfo->skip_precommit = skip_precommit != 0;
+	gtx_state->status = (GlobalTxStatus) status;
+	gtx_state->proposal.ballot = (int) terms[0];
+	gtx_state->proposal.node_id = (int) terms[1];
+	gtx_state->accepted.ballot = (int) terms[2];
+	gtx_state->accepted.node_id = (int) terms[3];
 	return 0;
+
+bad:
+	mtm_log(elevel, "GlobalTxLoadAll: failed to deparse state_3pc %s, ignoring it (res=%d)",
+			state, n_parsed);
+	return n_parsed > 0 ? n_parsed : -1;
 }
 
 void
@@ -149,6 +383,37 @@ GlobalTxAtExit(int code, Datum arg)
 {
 	if (my_locked_gtx)
 		GlobalTxRelease(my_locked_gtx);
+
+	if (my_gtx_slot != NULL && my_gtx_slot->stuck)
+	{
+		uint32		hashcode = my_gtx_slot->gtx.hashcode;
+
+		if (gtx_slot_migrate(my_gtx_slot, hashcode, true, true))
+			ConditionVariableBroadcast(GlobalTxPartitionCV(hashcode));
+		else
+			ResolverWake();
+	}
+}
+
+/*
+ * Number of gtx slots, one per backend. MaxBackends is not known yet when
+ * shmem is requested, so count it like dmq_shmem_size does.
+ */
+static int
+gtx_n_slots(void)
+{
+	return MaxConnections + autovacuum_max_workers +
+		max_worker_processes + max_wal_senders + 1;
+}
+
+static int
+gtx_n_slot_buckets(void)
+{
+	int			n_buckets = 1;
+
+	while (n_buckets < gtx_n_slots())
+		n_buckets <<= 1;
+	return n_buckets;
 }
 
 void
@@ -159,10 +424,19 @@ MtmGlobalTxInit()
 	size = add_size(size, sizeof(gtx_shared_data));
 	size = add_size(size, hash_estimate_size(2*MaxConnections,
 											 sizeof(GlobalTx)));
+	size = add_size(size, mul_size(gtx_n_slots(), sizeof(GlobalTxSlot)));
+	size = add_size(size, mul_size(gtx_n_slot_buckets(),
+								   sizeof(GlobalTxSlotBucket)));
+	size = add_size(size, mul_size(GTX_NUM_PARTITIONS,
+								   sizeof(GlobalTxOutcomeRing)));
+	size = add_size(size, hash_estimate_size(GTX_NUM_PARTITIONS * GTX_OUTCOMES_PER_PARTITION,
+											 sizeof(GlobalTxOutcome)));
 	size = MAXALIGN(size);
 
 	RequestAddinShmemSpace(size);
-	RequestNamedLWLockTranche("mtm-gtx-lock", 1);
+	/* partition locks and orphans_lock */
+	RequestNamedLWLockTranche("mtm-gtx-lock", GTX_NUM_PARTITIONS + 1);
+	RequestNamedLWLockTranche("mtm-gtx-outcome-lock", GTX_NUM_PARTITIONS);
 }
 
 void
@@ -174,6 +448,7 @@ MtmGlobalTxShmemStartup(void)
 	memset(&info, 0, sizeof(info));
 	info.keysize = GIDSIZE;
 	info.entrysize = sizeof(GlobalTx);
+	info.num_partitions = GTX_NUM_PARTITIONS;
 
 	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
 
@@ -182,12 +457,180 @@ MtmGlobalTxShmemStartup(void)
 								 &found);
 
 	if (!found)
-		gtx_shared->lock = &(GetNamedLWLockTranche("mtm-gtx-lock"))->lock;
+	{
+		int			i;
+
+		gtx_shared->locks = GetNamedLWLockTranche("mtm-gtx-lock");
+		for (i = 0; i < GTX_NUM_PARTITIONS; i++)
+			ConditionVariableInit(&gtx_shared->released_cvs[i]);
+		gtx_shared->orphans_lock = &gtx_shared->locks[GTX_NUM_PARTITIONS].lock;
+		dlist_init(&gtx_shared->orphans);
+		gtx_shared->n_orphans = 0;
+		pg_atomic_init_u64(&gtx_shared->max_proposal, 0);
+	}
+
+	gtx_shared->slots = ShmemInitStruct("mtm-gtx-slots",
+										mul_size(gtx_n_slots(), sizeof(GlobalTxSlot)),
+										&found);
+	gtx_shared->slot_buckets = ShmemInitStruct("mtm-gtx-slot-buckets",
+											   mul_size(gtx_n_slot_buckets(),
+														sizeof(GlobalTxSlotBucket)),
+											   &found);
+	if (!found)
+	{
+		int			i;
+
+		gtx_shared->n_slots = gtx_n_slots();
+		gtx_shared->n_slot_buckets = gtx_n_slot_buckets();
+		for (i = 0; i < gtx_shared->n_slots; i++)
+		{
+			gtx_shared->slots[i].xid = InvalidTransactionId;
+			gtx_shared->slots[i].stuck = false;
+		}
+		pg_atomic_init_u32(&gtx_shared->n_stuck_slots, 0);
+		for (i = 0; i < gtx_shared->n_slot_buckets; i++)
+		{
+			SpinLockInit(&gtx_shared->slot_buckets[i].mutex);
+			gtx_shared->slot_buckets[i].head = -1;
+		}
+	}
 
 	gtx_shared->gid2gtx = ShmemInitHash("gid2gtx", 2*MaxConnections, 2*MaxConnections,
-							&info, HASH_ELEM);
+							&info, HASH_ELEM | HASH_PARTITION);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(MtmGid);
+	info.entrysize = sizeof(GlobalTxOutcome);
+	info.num_partitions = GTX_NUM_PARTITIONS;
+	gtx_shared->outcomes = ShmemInitHash("mtm-gtx-outcomes",
+										 GTX_NUM_PARTITIONS * GTX_OUTCOMES_PER_PARTITION,
+										 GTX_NUM_PARTITIONS * GTX_OUTCOMES_PER_PARTITION,
+										 &info,
+										 HASH_ELEM | HASH_BLOBS | HASH_PARTITION);
+	gtx_shared->outcome_rings = ShmemInitStruct("mtm-gtx-outcome-rings",
+												GTX_NUM_PARTITIONS * sizeof(GlobalTxOutcomeRing),
+												&found);
+	if (!found)
+	{
+		memset(gtx_shared->outcome_rings, 0,
+			   GTX_NUM_PARTITIONS * sizeof(GlobalTxOutcomeRing));
+		gtx_shared->outcome_locks = GetNamedLWLockTranche("mtm-gtx-outcome-lock");
+		GlobalTxOutcomesLoad();
+	}
 
 	LWLockRelease(AddinShmemInitLock);
+
+	/* like pg_stat_statements, postmaster saves the index on exit */
+	if (!IsUnderPostmaster)
+		on_shmem_exit(GlobalTxOutcomesSave, (Datum) 0);
+}
+
+/*
+ * Lock all gid2gtx partitions, for sequential scans of the hash. Partitions
+ * are always locked in ascending order; everyone else holds at most one
+ * partition lock at a time, so this can't deadlock.
+ */
+void
+GlobalTxLockAll(LWLockMode mode)
+{
+	int			i;
+
+	for (i = 0; i < GTX_NUM_PARTITIONS; i++)
+		LWLockAcquire(&gtx_shared->locks[i].lock, mode);
+}
+
+void
+GlobalTxUnlockAll(void)
+{
+	int			i;
+
+	for (i = GTX_NUM_PARTITIONS - 1; i >= 0; i--)
+		LWLockRelease(&gtx_shared->locks[i].lock);
+}
+
+/*
+ * Link gtx into orphans list. Caller must hold its partition lock
+ * exclusively (or all of them).
+ */
+static void
+gtx_orphan_link(GlobalTx *gtx)
+{
+	if (gtx->orphan_listed)
+		return;
+
+	LWLockAcquire(gtx_shared->orphans_lock, LW_EXCLUSIVE);
+	dlist_push_tail(&gtx_shared->orphans, &gtx->orphan_node);
+	gtx_shared->n_orphans++;
+	LWLockRelease(gtx_shared->orphans_lock);
+	gtx->orphan_listed = true;
+}
+
+/* ditto, must be called before removing gtx from the hash */
+static void
+gtx_orphan_unlink(GlobalTx *gtx)
+{
+	if (!gtx->orphan_listed)
+		return;
+
+	LWLockAcquire(gtx_shared->orphans_lock, LW_EXCLUSIVE);
+	dlist_delete(&gtx->orphan_node);
+	gtx_shared->n_orphans--;
+	LWLockRelease(gtx_shared->orphans_lock);
+	gtx->orphan_listed = false;
+}
+
+/*
+ * Return number of orphaned gtxes and their gids in palloc'ed *gids. This
+ * is a snapshot: by the time caller looks at them some might be gone, and
+ * acquired ones are listed too.
+ */
+int
+GlobalTxListOrphaned(pgid_t **gids)
+{
+	dlist_iter	iter;
+	int			n_gids = 0;
+
+	LWLockAcquire(gtx_shared->orphans_lock, LW_SHARED);
+	*gids = palloc(sizeof(pgid_t) * Max(gtx_shared->n_orphans, 1));
+	dlist_foreach(iter, &gtx_shared->orphans)
+	{
+		GlobalTx   *gtx = dlist_container(GlobalTx, orphan_node, iter.cur);
+
+		Assert(n_gids < gtx_shared->n_orphans);
+		strcpy((*gids)[n_gids], gtx->gid);
+		n_gids++;
+	}
+	LWLockRelease(gtx_shared->orphans_lock);
+
+	return n_gids;
+}
+
+/*
+ * Find gtx and lock its partition in given mode without acquiring gtx
+ * itself, for a quick look (or a change which is allowed regardless of who
+ * acquired it). Returns NULL, leaving nothing locked, if there is no such
+ * gtx; otherwise release with GlobalTxUnlock.
+ */
+GlobalTx *
+GlobalTxLockByGid(const char *gid, LWLockMode mode)
+{
+	uint32		hashcode = get_hash_value(gtx_shared->gid2gtx, gid);
+	LWLock	   *partition_lock = GlobalTxPartitionLock(hashcode);
+	GlobalTx   *gtx;
+
+	LWLockAcquire(partition_lock, mode);
+	gtx = (GlobalTx *) hash_search_with_hash_value(gtx_shared->gid2gtx,
+												   gid, hashcode,
+												   HASH_FIND, NULL);
+	if (gtx == NULL)
+		LWLockRelease(partition_lock);
+	return gtx;
+}
+
+void
+GlobalTxUnlock(GlobalTx *gtx)
+{
+	LWLockRelease(GlobalTxPartitionLock(gtx->hashcode));
 }
 
 /*
@@ -203,12 +646,100 @@ GlobalTxEnsureBeforeShmemExitHook(void)
 	}
 }
 
+static void
+gtx_init(GlobalTx *gtx, uint32 hashcode)
+{
+	gtx->hashcode = hashcode;
+	gtx->acquired_by = MyBackendId;
+	gtx->state.status = GTXInvalid;
+	gtx->state.proposal = InitialGTxTerm;
+	gtx->state.accepted = InvalidGTxTerm;
+	gtx->prepared = false;
+	gtx->orphaned = false;
+	gtx->resolver_stage = GTRS_AwaitStatus;
+	memset(gtx->phase1_acks, 0, sizeof(gtx->phase1_acks));
+	memset(gtx->phase2_acks, 0, sizeof(gtx->phase2_acks));
+	gtx->orphan_listed = false;
+}
+
+static inline GlobalTxSlotBucket *
+gtx_slot_bucket(TransactionId xid)
+{
+	return &gtx_shared->slot_buckets[xid & (gtx_shared->n_slot_buckets - 1)];
+}
+
+static void
+gtx_slot_link(GlobalTxSlot *slot, TransactionId xid, uint64 gen_num)
+{
+	GlobalTxSlotBucket *bucket = gtx_slot_bucket(xid);
+
+	SpinLockAcquire(&bucket->mutex);
+	slot->xid = xid;
+	slot->gen_num = gen_num;
+	slot->next = bucket->head;
+	bucket->head = slot - gtx_shared->slots;
+	SpinLockRelease(&bucket->mutex);
+}
+
+static void
+gtx_slot_unlink(GlobalTxSlot *slot)
+{
+	GlobalTxSlotBucket *bucket = gtx_slot_bucket(slot->xid);
+	int		   *link;
+
+	SpinLockAcquire(&bucket->mutex);
+	for (link = &bucket->head; *link != slot - gtx_shared->slots;
+		 link = &gtx_shared->slots[*link].next)
+		Assert(*link != -1);
+	*link = slot->next;
+	slot->xid = InvalidTransactionId;
+	SpinLockRelease(&bucket->mutex);
+}
+
+/*
+ * Check whether gtx with this gid is in some slot and whether it is
+ * orphaned. Slot can be released any moment (though it is moved into
+ * gid2gtx only under partition lock), so the result is good only to decide
+ * whether to wait on the partition CV.
+ */
+static bool
+gtx_slot_lookup(const char *gid, bool *orphaned)
+{
+	MtmGid		parsed;
+	GlobalTxSlotBucket *bucket;
+	int			i;
+	bool		found = false;
+
+	/* only xacts coordinated here live in slots */
+	if (!MtmGidParse(gid, &parsed) || parsed.node_id != Mtm->my_node_id)
+		return false;
+
+	bucket = gtx_slot_bucket(parsed.xid);
+	SpinLockAcquire(&bucket->mutex);
+	for (i = bucket->head; i != -1; i = gtx_shared->slots[i].next)
+	{
+		GlobalTxSlot *slot = &gtx_shared->slots[i];
+
+		if (slot->xid == parsed.xid && slot->gen_num == parsed.gen_num)
+		{
+			if (orphaned)
+				*orphaned = slot->gtx.orphaned;
+			found = true;
+			break;
+		}
+	}
+	SpinLockRelease(&bucket->mutex);
+
+	return found;
+}
+
 /*
  * Obtain a global tx and lock it on calling backend.
  *
  * Several backend can try to access same gtx only during resolving
- * procedure and even then it's quite unlikely event. So just sleep a
- * bit.
+ * procedure and even then it's quite unlikely event. Still, whoever comes
+ * second shouldn't wait longer than necessary, so sleep on the partition
+ * condition variable until some gtx there is released and look again.
  *
  * Here we allow for a global tx to be created again even when we saw
  * that tx as locked but later it was deleted from hash. That may happen
@@ -219,6 +750,9 @@ GlobalTxEnsureBeforeShmemExitHook(void)
  *	  Status is racing with commit -- that is okay, we later will scan WAL
  * will read that commit (abort).
  *
+ * Gtx of xact which is still being coordinated by our backend is not in the
+ * hash but in the backend's slot; we can only wait for its release there.
+ *
  * If nowait_own_live is true, gtx is already locked, I am the coordinator and
  * gtx is not orphaned, don't wait for release -- backend is still working on
  * xact, which may be very long. *busy (if provided) is set to true in this
@@ -230,6 +764,9 @@ GlobalTxAcquire(const char *gid, bool create, bool nowait_own_live, bool *busy,
 {
 	GlobalTx   *gtx = NULL;
 	bool		found;
+	uint32		hashcode;
+	LWLock	   *partition_lock;
+	ConditionVariable *released_cv;
 
 	if (!gtx_exit_registered)
 	{
@@ -237,28 +774,32 @@ GlobalTxAcquire(const char *gid, bool create, bool nowait_own_live, bool *busy,
 		gtx_exit_registered = true;
 	}
 
-	LWLockAcquire(gtx_shared->lock, LW_EXCLUSIVE);
+	hashcode = get_hash_value(gtx_shared->gid2gtx, gid);
+	partition_lock = GlobalTxPartitionLock(hashcode);
+	released_cv = GlobalTxPartitionCV(hashcode);
+
+	LWLockAcquire(partition_lock, LW_EXCLUSIVE);
 
 	/* Repeat attempts to acquire a global tx */
 	while (true)
 	{
-		gtx = (GlobalTx *) hash_search(gtx_shared->gid2gtx, gid, HASH_FIND, &found);
+		bool		in_slot = false;
+		bool		orphaned;
 
+		gtx = (GlobalTx *) hash_search_with_hash_value(gtx_shared->gid2gtx,
+													   gid, hashcode,
+													   HASH_FIND, &found);
 		if (!found)
+			in_slot = gtx_slot_lookup(gid, &orphaned);
+
+		if (!found && !in_slot)
 		{
 			if (create)
 			{
-				gtx = (GlobalTx *) hash_search(gtx_shared->gid2gtx, gid, HASH_ENTER, &found);
-
-				gtx->acquired_by = MyBackendId;
-				gtx->state.status = GTXInvalid;
-				gtx->state.proposal = InitialGTxTerm;
-				gtx->state.accepted = InvalidGTxTerm;
-				gtx->prepared = false;
-				gtx->orphaned = false;
-				gtx->resolver_stage = GTRS_AwaitStatus;
-				memset(gtx->phase1_acks, 0, sizeof(gtx->phase1_acks));
-				memset(gtx->phase2_acks, 0, sizeof(gtx->phase2_acks));
+				gtx = (GlobalTx *) hash_search_with_hash_value(gtx_shared->gid2gtx,
+															   gid, hashcode,
+															   HASH_ENTER, &found);
+				gtx_init(gtx, hashcode);
 			}
 			else
 			{
@@ -270,29 +811,39 @@ GlobalTxAcquire(const char *gid, bool create, bool nowait_own_live, bool *busy,
 			break;
 		}
 
-		if (gtx->acquired_by == InvalidBackendId)
+		/* gtx in slot is always acquired by its owner */
+		if (found && gtx->acquired_by == InvalidBackendId)
 		{
 			gtx->acquired_by = MyBackendId;
 			break;
 		}
 
+		if (found)
+			orphaned = gtx->orphaned;
 		if (nowait_own_live)
 		{
-			if (coordinator == Mtm->my_node_id && !gtx->orphaned)
+			if (coordinator == Mtm->my_node_id && !orphaned)
 			{
 				if (busy)
 					*busy = true;
-				LWLockRelease(gtx_shared->lock);
+				LWLockRelease(partition_lock);
+				ConditionVariableCancelSleep();
 				return NULL;
 			}
 		}
 
-		LWLockRelease(gtx_shared->lock);
-		MtmSleep(USECS_PER_SEC / 10);
-		LWLockAcquire(gtx_shared->lock, LW_EXCLUSIVE);
+		/*
+		 * The first sleep only puts us into the wait queue and returns
+		 * immediately, so release happening between LWLockRelease and
+		 * sleeping is not missed: we just recheck once more.
+		 */
+		LWLockRelease(partition_lock);
+		ConditionVariableSleep(released_cv, PG_WAIT_EXTENSION);
+		LWLockAcquire(partition_lock, LW_EXCLUSIVE);
 	}
 
-	LWLockRelease(gtx_shared->lock);
+	LWLockRelease(partition_lock);
+	ConditionVariableCancelSleep();
 	my_locked_gtx = gtx;
 	/* not prepared and finalized gtxes are purged immediately on release */
 	if (found)
@@ -304,6 +855,169 @@ GlobalTxAcquire(const char *gid, bool create, bool nowait_own_live, bool *busy,
 	return gtx;
 }
 
+/*
+ * Obtain gtx for xact coordinated by this backend: it is put into our slot
+ * instead of gid2gtx, see GlobalTxSlot. gid must be generated by
+ * MtmGenerateGid for our top xid, so nobody else can have it.
+ */
+GlobalTx *
+GlobalTxAcquireLocal(const char *gid)
+{
+	MtmGid		parsed;
+	GlobalTx   *gtx;
+
+	if (!gtx_exit_registered)
+	{
+		before_shmem_exit(GlobalTxAtExit, 0);
+		gtx_exit_registered = true;
+	}
+	if (my_gtx_slot == NULL)
+	{
+		Assert(MyBackendId <= gtx_shared->n_slots);
+		my_gtx_slot = &gtx_shared->slots[MyBackendId - 1];
+	}
+
+	if (!MtmGidParse(gid, &parsed) || parsed.node_id != Mtm->my_node_id)
+		elog(ERROR, "[MTM] gid %s is not generated by this node", gid);
+
+	/* previous owner of the slot failed to hand over its xact; it's fine to ERROR here */
+	if (my_gtx_slot->stuck)
+	{
+		uint32		hashcode = my_gtx_slot->gtx.hashcode;
+
+		gtx_slot_migrate(my_gtx_slot, hashcode, true, false);
+		ConditionVariableBroadcast(GlobalTxPartitionCV(hashcode));
+	}
+	pg_read_barrier();
+	Assert(my_gtx_slot->xid == InvalidTransactionId);
+
+	gtx = &my_gtx_slot->gtx;
+	strlcpy(gtx->gid, gid, GIDSIZE);
+	gtx_init(gtx, get_hash_value(gtx_shared->gid2gtx, gid));
+	gtx_slot_link(my_gtx_slot, parsed.xid, parsed.gen_num);
+
+	my_locked_gtx = gtx;
+	return gtx;
+}
+
+/*
+ * Move gtx with unknown outcome from the slot into gid2gtx, where resolver
+ * finds it. Returns false if missing_ok and there is no shmem for it.
+ * Caller should broadcast partition CV afterwards.
+ *
+ * The owner moves its own slot with stuck=false. Anyone may move a stuck
+ * slot, passing hashcode read after seeing the flag; if somebody else has
+ * already done that, there is nothing left to do.
+ */
+static bool
+gtx_slot_migrate(GlobalTxSlot *slot, uint32 hashcode, bool stuck,
+				 bool missing_ok)
+{
+	GlobalTx   *gtx = &slot->gtx;
+	LWLock	   *partition_lock = GlobalTxPartitionLock(hashcode);
+	GlobalTx   *entry;
+	bool		found;
+
+	LWLockAcquire(partition_lock, LW_EXCLUSIVE);
+	if (stuck && (!slot->stuck || gtx->hashcode != hashcode))
+	{
+		LWLockRelease(partition_lock);
+		return true;
+	}
+	entry = (GlobalTx *) hash_search_with_hash_value(gtx_shared->gid2gtx,
+													 gtx->gid, gtx->hashcode,
+													 missing_ok ? HASH_ENTER_NULL : HASH_ENTER,
+													 &found);
+	if (entry == NULL)
+	{
+		LWLockRelease(partition_lock);
+		return false;
+	}
+	/* GlobalTxLoadAll skips xacts in slots, but if it is here, trust it */
+	if (!found)
+	{
+		memcpy(entry, gtx, sizeof(GlobalTx));
+		entry->acquired_by = InvalidBackendId;
+		if (entry->orphaned)
+		{
+			gtx_orphan_link(entry);
+			mtm_log(ResolverTasks, "transaction %s is orphaned", entry->gid);
+		}
+	}
+	/* with partition lock held, lookers see either slot or the entry */
+	gtx_slot_unlink(slot);
+	if (slot->stuck)
+	{
+		slot->stuck = false;
+		pg_atomic_fetch_sub_u32(&gtx_shared->n_stuck_slots, 1);
+	}
+	LWLockRelease(partition_lock);
+	return true;
+}
+
+/*
+ * Called by resolver: move into gid2gtx xacts left in stuck slots, possibly
+ * by backends which are gone and won't retry themselves.
+ */
+void
+GlobalTxMigrateStuck(void)
+{
+	int			i;
+
+	if (pg_atomic_read_u32(&gtx_shared->n_stuck_slots) == 0)
+		return;
+
+	for (i = 0; i < gtx_shared->n_slots; i++)
+	{
+		GlobalTxSlot *slot = &gtx_shared->slots[i];
+		uint32		hashcode;
+
+		if (!slot->stuck)
+			continue;
+		pg_read_barrier();
+		hashcode = slot->gtx.hashcode;
+		if (!gtx_slot_migrate(slot, hashcode, true, true))
+			break;
+		ConditionVariableBroadcast(GlobalTxPartitionCV(hashcode));
+	}
+}
+
+/*
+ * Release gtx in our slot. Finished (or not even prepared) one just
+ * disappears; otherwise it is moved into gid2gtx where resolver will find
+ * it.
+ */
+static void
+GlobalTxReleaseLocal(GlobalTx *gtx)
+{
+	uint32		hashcode = gtx->hashcode;
+
+	if ((gtx->state.status == GTXCommitted) ||
+		(gtx->state.status == GTXAborted) ||
+		(!gtx->prepared))
+	{
+		if (gtx->prepared)
+			GlobalTxRememberOutcome(gtx->gid, gtx->state.status);
+		gtx_slot_unlink(my_gtx_slot);
+	}
+	/*
+	 * We are likely in error cleanup here, so don't ERROR; lookers keep
+	 * waiting for the stuck slot until it is moved.
+	 */
+	else if (!gtx_slot_migrate(my_gtx_slot, hashcode, false, true))
+	{
+		/* gtx must be seen complete by whoever sees the flag */
+		pg_write_barrier();
+		my_gtx_slot->stuck = true;
+		pg_atomic_fetch_add_u32(&gtx_shared->n_stuck_slots, 1);
+		mtm_log(WARNING, "no shared memory to hand over transaction %s to resolver, will retry",
+				gtx->gid);
+	}
+
+	ConditionVariableBroadcast(GlobalTxPartitionCV(hashcode));
+	my_locked_gtx = NULL;
+}
+
 /*
  * Release our lock on this transaction and remove it from hash if it is
  * finished. We also remove shmem entry if gtx is not prepared: it is used
@@ -314,10 +1028,20 @@ void
 GlobalTxRelease(GlobalTx *gtx)
 {
 	bool		found;
+	uint32		hashcode = gtx->hashcode;
+	LWLock	   *partition_lock;
 
 	Assert(gtx->acquired_by == MyBackendId);
 
-	LWLockAcquire(gtx_shared->lock, LW_EXCLUSIVE);
+	if (my_gtx_slot != NULL && gtx == &my_gtx_slot->gtx)
+	{
+		GlobalTxReleaseLocal(gtx);
+		return;
+	}
+
+	partition_lock = GlobalTxPartitionLock(hashcode);
+
+	LWLockAcquire(partition_lock, LW_EXCLUSIVE);
 	gtx->acquired_by = InvalidBackendId;
 
 	/* status GTXInvalid can be caused by an error during PREPARE */
@@ -325,14 +1049,22 @@ GlobalTxRelease(GlobalTx *gtx)
 		(gtx->state.status == GTXAborted) ||
 		(!gtx->prepared))
 	{
-		hash_search(gtx_shared->gid2gtx, gtx->gid, HASH_REMOVE, &found);
+		if (gtx->prepared &&
+			(gtx->state.status == GTXCommitted ||
+			 gtx->state.status == GTXAborted))
+			GlobalTxRememberOutcome(gtx->gid, gtx->state.status);
+		gtx_orphan_unlink(gtx);
+		hash_search_with_hash_value(gtx_shared->gid2gtx, gtx->gid, hashcode,
+									HASH_REMOVE, &found);
 	}
 	else if (gtx->orphaned)
 	{
+		gtx_orphan_link(gtx);
 		mtm_log(ResolverTasks, "transaction %s is orphaned", gtx->gid);
 	}
 
-	LWLockRelease(gtx_shared->lock);
+	LWLockRelease(partition_lock);
+	ConditionVariableBroadcast(GlobalTxPartitionCV(hashcode));
 
 	my_locked_gtx = NULL;
 }
@@ -352,7 +1084,7 @@ GlobalTxLoadAll()
 	HASH_SEQ_STATUS hash_seq;
 	GlobalTx   *gtx;
 
-	LWLockAcquire(gtx_shared->lock, LW_EXCLUSIVE);
+	GlobalTxLockAll(LW_EXCLUSIVE);
 
 	/*
 	 * This is called without shmem reset if monitor restarts.
@@ -364,6 +1096,10 @@ GlobalTxLoadAll()
 		gtx = (GlobalTx *) hash_search(gtx_shared->gid2gtx, gtx->gid,
 									   HASH_REMOVE, NULL);
 	}
+	LWLockAcquire(gtx_shared->orphans_lock, LW_EXCLUSIVE);
+	dlist_init(&gtx_shared->orphans);
+	gtx_shared->n_orphans = 0;
+	LWLockRelease(gtx_shared->orphans_lock);
 
 	/* Walk over postgres gxacts */
 	n_xacts = GetPreparedTransactions(&pxacts);
@@ -371,10 +1107,19 @@ GlobalTxLoadAll()
 	{
 		GlobalTx   *gtx;
 		bool		found;
+		uint32		hashcode;
+
+		/* xact of live backend, it hands it over itself */
+		if (gtx_slot_lookup(pxacts[i].gid, NULL))
+			continue;
 
-		gtx = (GlobalTx *) hash_search(gtx_shared->gid2gtx, pxacts[i].gid, HASH_ENTER, &found);
+		hashcode = get_hash_value(gtx_shared->gid2gtx, pxacts[i].gid);
+		gtx = (GlobalTx *) hash_search_with_hash_value(gtx_shared->gid2gtx,
+													   pxacts[i].gid, hashcode,
+													   HASH_ENTER, &found);
 		Assert(!found);
 
+		gtx->hashcode = hashcode;
 		gtx->acquired_by = InvalidBackendId;
 		/*
 		 * Allow instance to start even if we have problems parsing xstate...
@@ -390,32 +1135,63 @@ GlobalTxLoadAll()
 		gtx->resolver_stage = GTRS_AwaitStatus;
 		memset(gtx->phase1_acks, 0, sizeof(gtx->phase1_acks));
 		memset(gtx->phase2_acks, 0, sizeof(gtx->phase2_acks));
+		gtx->orphan_listed = false;
+		gtx_orphan_link(gtx);
+		GlobalTxNoteProposal(gtx->state.proposal);
 	}
 
-	LWLockRelease(gtx_shared->lock);
+	GlobalTxUnlockAll();
 }
 
 
 /*
- * Get maximum proposal among all transactions.
+ * Terms are ordered by (ballot, node_id), both non-negative, so packed
+ * terms compare as unsigned integers the same way term_cmp does.
  */
-GlobalTxTerm
-GlobalTxGetMaxProposal()
+static inline uint64
+GlobalTxTermPack(GlobalTxTerm term)
 {
-	HASH_SEQ_STATUS hash_seq;
-	GlobalTx   *gtx;
-	GlobalTxTerm max_prop = (GlobalTxTerm) {0, 0};
+	Assert(term.ballot >= 0 && term.node_id >= 0);
+	return ((uint64) term.ballot << 32) | (uint32) term.node_id;
+}
 
-	LWLockAcquire(gtx_shared->lock, LW_SHARED);
-	hash_seq_init(&hash_seq, gtx_shared->gid2gtx);
-	while ((gtx = hash_seq_search(&hash_seq)) != NULL)
+static inline GlobalTxTerm
+GlobalTxTermUnpack(uint64 packed)
+{
+	return (GlobalTxTerm) {(int) (packed >> 32), (int) (uint32) packed};
+}
+
+/*
+ * Must be called whenever proposal term of some gtx is set to anything but
+ * InitialGTxTerm: resolver generates terms above the maximum, and those are
+ * always above InitialGTxTerm anyway.
+ */
+void
+GlobalTxNoteProposal(GlobalTxTerm term)
+{
+	uint64		packed = GlobalTxTermPack(term);
+	uint64		cur = pg_atomic_read_u64(&gtx_shared->max_proposal);
+
+	while (cur < packed)
 	{
-		if (term_cmp(max_prop, gtx->state.proposal) < 0)
-			max_prop = gtx->state.proposal;
+		if (pg_atomic_compare_exchange_u64(&gtx_shared->max_proposal,
+										   &cur, packed))
+			break;
 	}
-	LWLockRelease(gtx_shared->lock);
+}
 
-	return max_prop;
+/*
+ * Get maximum proposal among all transactions we have seen since startup.
+ *
+ * Values stamped on xacts which are already finished are included, which
+ * is harmless: resolver only needs the result to be at least the maximum
+ * proposal among current ones. After restart the value is rebuilt from
+ * prepared xacts by GlobalTxLoadAll.
+ */
+GlobalTxTerm
+GlobalTxGetMaxProposal()
+{
+	return GlobalTxTermUnpack(pg_atomic_read_u64(&gtx_shared->max_proposal));
 }
 
 
@@ -425,17 +1201,252 @@ GlobalTxMarkOrphaned(int node_id)
 	HASH_SEQ_STATUS hash_seq;
 	GlobalTx   *gtx;
 
-	LWLockAcquire(gtx_shared->lock, LW_EXCLUSIVE);
+	GlobalTxLockAll(LW_EXCLUSIVE);
 	hash_seq_init(&hash_seq, gtx_shared->gid2gtx);
 	while ((gtx = hash_seq_search(&hash_seq)) != NULL)
 	{
 		if (gtx->xinfo.coordinator == node_id)
 		{
 			gtx->orphaned = true;
+			gtx_orphan_link(gtx);
 			mtm_log(ResolverTasks, "%s is orphaned", gtx->gid);
 		}
 	}
-	LWLockRelease(gtx_shared->lock);
+	GlobalTxUnlockAll();
+}
+
+/*
+ * Remember final status of finished xact in outcome index. Called on gtx
+ * release, possibly under gid2gtx partition lock; outcome locks are always
+ * taken after it.
+ */
+static void
+GlobalTxRememberOutcome(const char *gid, GlobalTxStatus status)
+{
+	MtmGid		key;
+	uint32		hashcode;
+	int			partition;
+	GlobalTxOutcomeRing *ring;
+	GlobalTxOutcome *outcome;
+	bool		found;
+
+	Assert(status == GTXCommitted || status == GTXAborted);
+
+	memset(&key, 0, sizeof(key));
+	if (!MtmGidParse(gid, &key))
+		return;
+
+	hashcode = get_hash_value(gtx_shared->outcomes, &key);
+	partition = GlobalTxHashPartition(hashcode);
+	ring = &gtx_shared->outcome_rings[partition];
+
+	LWLockAcquire(&gtx_shared->outcome_locks[partition].lock, LW_EXCLUSIVE);
+
+	outcome = hash_search_with_hash_value(gtx_shared->outcomes, &key, hashcode,
+										  HASH_FIND, NULL);
+	if (outcome == NULL)
+	{
+		MtmGid	   *slot = &ring->slots[ring->next];
+
+		/* evict the oldest entry of the partition */
+		if (slot->node_id != 0)
+			hash_search(gtx_shared->outcomes, slot, HASH_REMOVE, NULL);
+
+		outcome = hash_search_with_hash_value(gtx_shared->outcomes, &key,
+											  hashcode, HASH_ENTER_NULL,
+											  &found);
+		/* the index is just a hint, don't fail commit if it is out of shmem */
+		if (outcome == NULL)
+			slot->node_id = 0;
+		else
+		{
+			*slot = key;
+			ring->next = (ring->next + 1) % GTX_OUTCOMES_PER_PARTITION;
+		}
+	}
+	if (outcome != NULL)
+		outcome->status = status;
+
+	LWLockRelease(&gtx_shared->outcome_locks[partition].lock);
+}
+
+/*
+ * Look up outcome of finished multimaster xact. Returns false if we don't
+ * know it; the xact might still be finished, WAL must be consulted then.
+ */
+bool
+GlobalTxLookupOutcome(const char *gid, GlobalTxStatus *status)
+{
+	MtmGid		key;
+	uint32		hashcode;
+	int			partition;
+	GlobalTxOutcome *outcome;
+
+	memset(&key, 0, sizeof(key));
+	if (!MtmGidParse(gid, &key))
+		return false;
+
+	hashcode = get_hash_value(gtx_shared->outcomes, &key);
+	partition = GlobalTxHashPartition(hashcode);
+
+	LWLockAcquire(&gtx_shared->outcome_locks[partition].lock, LW_SHARED);
+	outcome = hash_search_with_hash_value(gtx_shared->outcomes, &key, hashcode,
+										  HASH_FIND, NULL);
+	if (outcome != NULL)
+		*status = outcome->status;
+	LWLockRelease(&gtx_shared->outcome_locks[partition].lock);
+
+	return outcome != NULL;
+}
+
+/*
+ * Dump outcome index on clean shutdown, oldest entries of each partition
+ * first. Runs in postmaster, so no locking and no ERRORs here.
+ */
+static void
+GlobalTxOutcomesSave(int code, Datum arg)
+{
+	const char *tmppath = GTX_OUTCOMES_FILE ".tmp";
+	FILE	   *file;
+	uint32		header[3];
+	uint32		n_written = 0;
+	pg_crc32c	crc;
+	int			p;
+
+	/* shmem might be inconsistent after crash, don't trust it */
+	if (code != 0 || gtx_shared == NULL || gtx_shared->outcomes == NULL)
+		return;
+
+	mkdir("pg_mtm", S_IRWXU);
+	file = AllocateFile(tmppath, PG_BINARY_W);
+	if (file == NULL)
+		goto error;
+
+	header[0] = GTX_OUTCOMES_MAGIC;
+	header[1] = GTX_OUTCOMES_VERSION;
+	header[2] = (uint32) hash_get_num_entries(gtx_shared->outcomes);
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, header, sizeof(header));
+	if (fwrite(header, sizeof(header), 1, file) != 1)
+		goto error;
+
+	for (p = 0; p < GTX_NUM_PARTITIONS; p++)
+	{
+		GlobalTxOutcomeRing *ring = &gtx_shared->outcome_rings[p];
+		int			i;
+
+		for (i = 0; i < GTX_OUTCOMES_PER_PARTITION; i++)
+		{
+			MtmGid	   *slot = &ring->slots[(ring->next + i) % GTX_OUTCOMES_PER_PARTITION];
+			GlobalTxOutcome *outcome;
+
+			if (slot->node_id == 0)
+				continue;
+			outcome = hash_search(gtx_shared->outcomes, slot, HASH_FIND, NULL);
+			if (outcome == NULL)
+				continue;
+			COMP_CRC32C(crc, outcome, sizeof(GlobalTxOutcome));
+			if (fwrite(outcome, sizeof(GlobalTxOutcome), 1, file) != 1)
+				goto error;
+			n_written++;
+		}
+	}
+	Assert(n_written == header[2]);
+
+	FIN_CRC32C(crc);
+	if (fwrite(&crc, sizeof(crc), 1, file) != 1)
+		goto error;
+	if (FreeFile(file))
+	{
+		file = NULL;
+		goto error;
+	}
+
+	(void) durable_rename(tmppath, GTX_OUTCOMES_FILE, LOG);
+	return;
+
+error:
+	ereport(LOG,
+			(errcode_for_file_access(),
+			 errmsg("could not write file \"%s\": %m", tmppath)));
+	if (file)
+		FreeFile(file);
+	unlink(tmppath);
+}
+
+/*
+ * Load outcome index saved on last clean shutdown, if any. Called in
+ * postmaster while creating shmem. Broken file is just ignored.
+ */
+static void
+GlobalTxOutcomesLoad(void)
+{
+	FILE	   *file;
+	uint32		header[3];
+	GlobalTxOutcome *outcomes;
+	pg_crc32c	crc;
+	pg_crc32c	file_crc;
+	uint32		i;
+
+	file = AllocateFile(GTX_OUTCOMES_FILE, PG_BINARY_R);
+	if (file == NULL)
+	{
+		if (errno != ENOENT)
+			ereport(LOG,
+					(errcode_for_file_access(),
+					 errmsg("could not read file \"%s\": %m", GTX_OUTCOMES_FILE)));
+		return;
+	}
+
+	if (fread(header, sizeof(header), 1, file) != 1 ||
+		header[0] != GTX_OUTCOMES_MAGIC ||
+		header[1] != GTX_OUTCOMES_VERSION ||
+		header[2] > GTX_NUM_PARTITIONS * GTX_OUTCOMES_PER_PARTITION)
+		goto broken;
+
+	outcomes = palloc(Max(header[2], 1) * sizeof(GlobalTxOutcome));
+	if (header[2] > 0 &&
+		fread(outcomes, sizeof(GlobalTxOutcome), header[2], file) != header[2])
+		goto broken;
+	if (fread(&file_crc, sizeof(file_crc), 1, file) != 1)
+		goto broken;
+
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, header, sizeof(header));
+	if (header[2] > 0)
+		COMP_CRC32C(crc, outcomes, header[2] * sizeof(GlobalTxOutcome));
+	FIN_CRC32C(crc);
+	if (!EQ_CRC32C(crc, file_crc))
+		goto broken;
+
+	/* single process yet, so no locking */
+	for (i = 0; i < header[2]; i++)
+	{
+		uint32		hashcode = get_hash_value(gtx_shared->outcomes,
+											  &outcomes[i].key);
+		GlobalTxOutcomeRing *ring =
+			&gtx_shared->outcome_rings[GlobalTxHashPartition(hashcode)];
+		GlobalTxOutcome *outcome;
+
+		outcome = hash_search_with_hash_value(gtx_shared->outcomes,
+											  &outcomes[i].key, hashcode,
+											  HASH_ENTER_NULL, NULL);
+		if (outcome == NULL)
+			break;
+		outcome->status = outcomes[i].status;
+		ring->slots[ring->next] = outcomes[i].key;
+		ring->next = (ring->next + 1) % GTX_OUTCOMES_PER_PARTITION;
+	}
+
+	pfree(outcomes);
+	FreeFile(file);
+	return;
+
+broken:
+	ereport(LOG,
+			(errcode(ERRCODE_DATA_CORRUPTED),
+			 errmsg("ignoring broken file \"%s\"", GTX_OUTCOMES_FILE)));
+	FreeFile(file);
 }
 
 static char *
@@ -6,6 +6,8 @@
 #include "postmaster/bgworker.h"
 #include "storage/condition_variable.h"
 #include "storage/dsm.h"
+#include "lib/dshash.h"
+#include "utils/dsa.h"
 
 #include "receiver.h"
 
@@ -67,6 +69,11 @@ typedef struct BgwPool
 	dsm_handle	dsmhandler;		/* DSM descriptor. Workers use it for
 								 * attaching */
 
+	/* Names of remote relations, see pglogical_relnames_create */
+	int			relnames_tranche;
+	dsa_handle	relnames_area;
+	dshash_table_handle relnames_table;
+
 	size_t		nWorkers;		/* a number of pool workers launched */
 	TimestampTz lastDynamicWorkerStartTime;
 	/* Handlers of workers at the pool */
@@ -24,8 +24,19 @@
  */
 #define IS_EXPLICIT_2PC_GID(gid) (strncmp((gid), "MTM-", 4) != 0)
 
+/*
+ * Binary form of multimaster gid, "MTM-<node_id>-<xid>-<gen_num>".
+ */
+typedef struct MtmGid
+{
+	int			node_id;
+	TransactionId xid;
+	uint64		gen_num;
+} MtmGid;
+
 extern void MtmGenerateGid(char *gid, int node_id, TransactionId xid,
 						   uint64 gen_num);
+extern bool MtmGidParse(const char *gid, MtmGid *parsed);
 extern uint64 MtmGidParseGenNum(const char *gid);
 extern int	MtmGidParseNodeId(const char *gid);
 extern TransactionId MtmGidParseXid(const char *gid);
@@ -17,6 +17,7 @@
 
 /* GUCs */
 extern bool MtmMonotonicSequences;
+extern int	MtmSequenceBlockSize;
 extern char *MtmRemoteFunctionsList;
 extern bool MtmRemoteFunctionsUpdating;
 extern bool MtmVolksWagenMode;
@@ -11,6 +11,9 @@
 #ifndef GLOBAL_TX_H
 #define GLOBAL_TX_H
 
+#include "lib/ilist.h"
+#include "storage/condition_variable.h"
+
 #include "multimaster.h"
 
 typedef struct
@@ -71,11 +74,19 @@ typedef struct
 							* first node add-rm are resolved before the
 							* second one is started
 							*/
+	bool skip_precommit; /* coordinator commits right after PREPARE, so
+						  * only it can tell the outcome; see
+						  * MtmAdaptiveCommit
+						  */
 } XactInfo;
 
+/* gid_t is system type... */
+typedef char pgid_t[GIDSIZE];
+
 typedef struct GlobalTx
 {
 	char		gid[GIDSIZE];
+	uint32		hashcode;	/* of gid in gid2gtx, saves rehashing on release */
 	XactInfo	xinfo;
 	XLogRecPtr	coordinator_end_lsn;
 	BackendId	acquired_by;
@@ -96,33 +107,91 @@ typedef struct GlobalTx
 	 */
 	GTxState	phase2_acks[MTM_MAX_NODES];
 	GlobalTxResolvingStage resolver_stage;
+	/* membership in gtx_shared->orphans */
+	bool		orphan_listed;
+	dlist_node	orphan_node;
 } GlobalTx;
 
+/*
+ * gid2gtx is partitioned the same way as buffer mapping table: entry with
+ * given hash code lives in partition hashcode % GTX_NUM_PARTITIONS and is
+ * protected by the lock of that partition. Looking at or changing a single
+ * gtx requires only its partition lock; sequential scan of the whole hash
+ * requires all of them, see GlobalTxLockAll. Must be a power of 2.
+ *
+ * Backends waiting for a gtx acquired by someone else sleep on the condition
+ * variable of its partition, which is broadcast on each release there.
+ *
+ * Orphaned gtxes which stay in the hash after release (or were marked
+ * orphaned in bulk) are also linked into orphans list, so that resolver
+ * doesn't have to scan the whole hash to find its work. The list is
+ * protected by orphans_lock, which is taken after partition lock(s) when
+ * both are needed. Entry is linked/unlinked only under its partition lock
+ * held exclusively, so orphan_listed may be read under partition lock.
+ */
+#define GTX_NUM_PARTITIONS 16
+
 typedef struct
 {
-	LWLock	   *lock;
+	LWLockPadded *locks;		/* GTX_NUM_PARTITIONS partition locks */
+	ConditionVariable released_cvs[GTX_NUM_PARTITIONS];
+	LWLock	   *orphans_lock;
+	dlist_head	orphans;
+	int			n_orphans;
+	/*
+	 * Highest proposal term ever set to any gtx since startup, packed by
+	 * GlobalTxTermPack. Only grows.
+	 */
+	pg_atomic_uint64 max_proposal;
 	HTAB	   *gid2gtx;
+	/* coordinator gtxes, one per backend, see GlobalTxAcquireLocal */
+	struct GlobalTxSlot *slots;
+	int			n_slots;
+	struct GlobalTxSlotBucket *slot_buckets;
+	int			n_slot_buckets;
+	pg_atomic_uint32 n_stuck_slots;	/* see GlobalTxMigrateStuck */
+
+	/* outcome index, see GlobalTxRememberOutcome */
+	LWLockPadded *outcome_locks;
+	struct GlobalTxOutcomeRing *outcome_rings;
+	HTAB	   *outcomes;
 } gtx_shared_data;
 
 extern gtx_shared_data *gtx_shared;
 
+#define GlobalTxHashPartition(hashcode) \
+	((hashcode) % GTX_NUM_PARTITIONS)
+#define GlobalTxPartitionLock(hashcode) \
+	(&gtx_shared->locks[GlobalTxHashPartition(hashcode)].lock)
+#define GlobalTxPartitionCV(hashcode) \
+	(&gtx_shared->released_cvs[GlobalTxHashPartition(hashcode)])
+
 void MtmGlobalTxInit(void);
 void MtmGlobalTxShmemStartup(void);
 void GlobalTxEnsureBeforeShmemExitHook(void);
 GlobalTx *GlobalTxAcquire(const char *gid, bool create, bool nowait_own_live,
 						  bool *busy, int coordinator);
+GlobalTx *GlobalTxAcquireLocal(const char *gid);
 void GlobalTxRelease(GlobalTx *gtx);
+void GlobalTxMigrateStuck(void);
 void GlobalTxAtExit(int code, Datum arg);
 void GlobalTxLoadAll(void);
+void GlobalTxLockAll(LWLockMode mode);
+void GlobalTxUnlockAll(void);
+int GlobalTxListOrphaned(pgid_t **gids);
+GlobalTx *GlobalTxLockByGid(const char *gid, LWLockMode mode);
+void GlobalTxUnlock(GlobalTx *gtx);
 char *serialize_xstate(XactInfo *xinfo, GTxState *gtx_state);
 int term_cmp(GlobalTxTerm t1, GlobalTxTerm t2);
 int deserialize_xstate(const char *state, XactInfo *xinfo, GTxState *gtx_state,
 					   int elevel);
 GlobalTxTerm GlobalTxGetMaxProposal(void);
+void GlobalTxNoteProposal(GlobalTxTerm term);
 void GlobalTxSaveInTable(const char *gid, XLogRecPtr coordinator_end_lsn,
 						 GlobalTxStatus status,
 						 GlobalTxTerm term_prop, GlobalTxTerm term_acc);
 void GlobalTxMarkOrphaned(int node_id);
+bool GlobalTxLookupOutcome(const char *gid, GlobalTxStatus *status);
 
 char *GlobalTxToString(GlobalTx *gtx);
 
@@ -235,8 +235,12 @@ extern char *MtmRefereeConnStr;
 extern int	MtmMaxWorkers;
 extern bool MtmBreakConnection;
 extern bool MtmWaitPeerCommits;
+extern bool MtmPipelineCommitAcks;
+extern bool MtmDirectPrecommit;
+extern bool MtmAdaptiveCommit;
 extern bool MtmNo3PC;
 extern bool MtmBinaryBasetypes;
+extern int	MtmStreamCompression;
 
 extern void MtmSleep(int64 interval);
 extern TimestampTz MtmGetIncreasingTimestamp(void);
@@ -0,0 +1,45 @@
+/*-------------------------------------------------------------------------
+ *
+ * pglogical_compress.h
+ *		Optional compression of the replication stream
+ *
+ * Portions Copyright (c) 2021, Postgres Professional
+ *
+ * IDENTIFICATION
+ *		pglogical_compress.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PGLOGICAL_COMPRESS_H
+#define PGLOGICAL_COMPRESS_H
+
+#include "lib/stringinfo.h"
+#include "utils/guc.h"
+
+typedef enum
+{
+	PGL_COMPRESSION_NONE = 0,
+	PGL_COMPRESSION_PGLZ = 1,
+	PGL_COMPRESSION_LZ4 = 2
+} PGLogicalCompression;
+
+/*
+ * Compressed CopyData payload is
+ *   'z' | method (1 byte) | raw length (4 bytes) | compressed data
+ * and decompresses exactly into what the sender would have sent otherwise.
+ */
+#define PGL_COMPRESSED_MSG 'z'
+#define PGL_COMPRESSED_HDR_LEN (1 + 1 + 4)
+
+/* don't bother with payloads smaller than that */
+#define PGL_COMPRESS_MIN_SIZE 256
+
+extern const struct config_enum_entry pglogical_compression_options[];
+
+extern int	pglogical_compression_by_name(const char *name);
+extern const char *pglogical_compression_name(int method);
+extern bool pglogical_compress(int method, const char *src, int srclen,
+							   StringInfo dst);
+extern void pglogical_decompress(const char *src, int srclen, StringInfo dst);
+
+#endif							/* PGLOGICAL_COMPRESS_H */
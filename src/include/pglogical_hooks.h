@@ -17,7 +17,7 @@ extern bool call_row_filter_hook(PGLogicalOutputData *data,
 					 ReorderBufferTXN *txn, Relation rel, ReorderBufferChange *change);
 
 extern bool call_txn_filter_hook(PGLogicalOutputData *data,
-					 RepOriginId txn_origin);
+					 RepOriginId txn_origin, XLogRecPtr origin_lsn);
 
 
 #endif
@@ -49,6 +49,12 @@ typedef struct MtmDecoderPrivate
 	int			receiver_node_id;
 	bool		is_recovery;
 	MtmConfig  *cfg;
+
+	/*
+	 * In recovery, receiver tells us up to which origin LSN it already has
+	 * transactions of each node (c.f. MtmFilterTransaction).
+	 */
+	XLogRecPtr	recovery_filter_lsn[MTM_MAX_NODES];
 } MtmDecoderPrivate;
 
 typedef struct PGLogicalOutputData
@@ -64,6 +70,14 @@ typedef struct PGLogicalOutputData
 	bool		forward_changeset_origins;
 	int			field_datum_encoding;
 
+	/* stream compression, see pglogical_compress.c */
+	int			compression;
+	int			payload_start;	/* where our data starts in ctx->out */
+	StringInfo	compress_buf;
+
+	/* current transaction is rejected by txn filter hook */
+	bool		skip_txn;
+
 	/*
 	 * client info
 	 *
@@ -95,6 +109,7 @@ typedef struct PGLogicalOutputData
 	bool		client_forward_changesets_set;
 	bool		client_forward_changesets;
 	bool		client_no_txinfo;
+	const char *client_compression;
 
 	/* hooks */
 	List	   *hooks_setup_funcname;
@@ -32,6 +32,8 @@ struct PGLogicalTxnFilterArgs
 {
 	void	   *private_data;
 	RepOriginId origin_id;
+	/* valid only once the transaction is being sent, not at origin filter */
+	XLogRecPtr	origin_lsn;
 };
 
 typedef bool (*pglogical_txn_filter_hook_fn) (struct PGLogicalTxnFilterArgs *args);
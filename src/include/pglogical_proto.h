@@ -15,14 +15,11 @@
 #define PG_LOGICAL_PROTO_H
 
 struct PGLogicalOutputData;
-struct PGLRelMetaCacheEntry;
 
 extern char *walsender_name;
 
-typedef void (*pglogical_write_rel_fn) (StringInfo out, struct PGLogicalOutputData *data,
-										Relation rel	/* , struct
-														 * PGLRelMetaCacheEntry
-										  * *cache_entry */ );
+typedef void (*pglogical_write_rel_fn) (StringInfo out, LogicalDecodingContext *ctx,
+										Relation rel);
 
 typedef void (*pglogical_write_begin_fn) (StringInfo out, struct PGLogicalOutputData *data,
 										  ReorderBufferTXN *txn);
@@ -1,6 +1,9 @@
 #ifndef PGLOGICAL_RELID_MAP
 #define PGLOGICAL_RELID_MAP
 
+#include "lib/dshash.h"
+#include "utils/dsa.h"
+
 #define PGL_INIT_RELID_MAP_SIZE 256
 
 typedef struct PGLRelidMapEntry
@@ -12,4 +15,25 @@ typedef struct PGLRelidMapEntry
 extern Oid	pglogical_relid_map_get(Oid relid);
 extern bool pglogical_relid_map_put(Oid remote_relid, Oid local_relid);
 extern void pglogical_relid_map_reset(void);
+
+/*
+ * Names of remote relations, shared by receiver and its apply workers.
+ * Sender transfers them only once per connection, while relation might be
+ * first touched by any of the workers.
+ */
+typedef struct PGLRelNamesEntry
+{
+	Oid			remote_relid;	/* hash key */
+	NameData	nspname;
+	NameData	relname;
+} PGLRelNamesEntry;
+
+extern void pglogical_relnames_create(int tranche_id, dsa_handle *area_handle,
+									  dshash_table_handle *table_handle);
+extern void pglogical_relnames_attach(int tranche_id, dsa_handle area_handle,
+									  dshash_table_handle table_handle);
+extern void pglogical_relnames_put(Oid remote_relid, const char *nspname,
+								   const char *relname);
+extern bool pglogical_relnames_get(Oid remote_relid, char **nspname,
+								   char **relname);
 #endif
@@ -0,0 +1,55 @@
+/*-------------------------------------------------------------------------
+ *
+ * pglogical_relmetacache.h
+ *		Per-relation metadata cached by the output plugin
+ *
+ * Portions Copyright (c) 2021, Postgres Professional
+ *
+ * IDENTIFICATION
+ *		pglogical_relmetacache.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PGLOGICAL_RELMETACACHE_H
+#define PGLOGICAL_RELMETACACHE_H
+
+#include "fmgr.h"
+#include "utils/relcache.h"
+
+#define RELMETACACHE_INITIAL_SIZE 128
+
+/*
+ * How a single live column is put on the wire.
+ */
+typedef struct PGLAttEncoding
+{
+	int			attidx;			/* 0-based index in the tuple descriptor */
+	int16		attlen;
+	bool		attbyval;
+	char		transfer_type;	/* 'b' (internal binary) or 't' (text) */
+	bool		is_key;			/* part of primary key */
+	uint32		typhashvalue;	/* TYPEOID syscache hash of column type */
+	FmgrInfo	typoutput;		/* output function, valid only for 't' */
+} PGLAttEncoding;
+
+/*
+ * Tuple encoding plan of the relation: everything pglogical_write_tuple
+ * otherwise would have to look up in syscache for each column of each row.
+ */
+typedef struct PGLRelMetaCacheEntry
+{
+	Oid			relid;			/* hash key */
+	bool		is_valid;		/* false once relcache/typcache invalidated */
+	bool		want_binary;	/* client_want_binary_basetypes used to build */
+	bool		has_pkey;		/* receiver will look the row up by pkey */
+	bool		names_sent;		/* receiver got schema and table names */
+	uint16		nliveatts;
+	MemoryContext cxt;			/* holds atts and output functions */
+	PGLAttEncoding *atts;		/* nliveatts entries */
+} PGLRelMetaCacheEntry;
+
+extern PGLRelMetaCacheEntry *pglogical_relmetacache_get(Relation rel,
+														bool want_binary);
+extern void pglogical_relmetacache_destroy(void);
+
+#endif							/* PGLOGICAL_RELMETACACHE_H */
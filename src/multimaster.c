@@ -49,6 +49,7 @@
 #include "messaging.h"
 #include "syncpoint.h"
 #include "mtm_utils.h"
+#include "pglogical_compress.h"
 
 #include "compat.h"
 
@@ -213,8 +214,12 @@ int			MtmHeartbeatRecvTimeout;
 char	   *MtmRefereeConnStr;
 bool		MtmBreakConnection;
 bool		MtmWaitPeerCommits;
+bool		MtmPipelineCommitAcks;
+bool		MtmDirectPrecommit;
+bool		MtmAdaptiveCommit;
 bool		MtmNo3PC;
 bool		MtmBinaryBasetypes;
+int			MtmStreamCompression;
 
 bool mtm_config_valid;
 
@@ -547,6 +552,21 @@ _PG_init(void)
 							 NULL
 		);
 
+	DefineCustomIntVariable(
+							"multimaster.sequence_block_size",
+							"Size of sequence value blocks announced to other nodes at once with monotonic_sequences",
+							"0 announces every value.",
+							&MtmSequenceBlockSize,
+							0,
+							0,
+							INT_MAX,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL
+		);
+
 	/* XXX */
 	DefineCustomBoolVariable(
 							 "multimaster.ignore_tables_without_pk",
@@ -645,6 +665,45 @@ NULL,
 NULL,
 NULL);
 
+	DefineCustomBoolVariable(
+							 "multimaster.pipeline_commit_acks",
+							 "With wait_peer_commits, wait for peers' commit confirmation at the start of the next transaction in the session instead of before returning success.",
+							 NULL,
+							 &MtmPipelineCommitAcks,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL
+		);
+
+	DefineCustomBoolVariable(
+							 "multimaster.direct_precommit",
+							 "Send precommit of the transaction to peers over dmq in addition to streaming it through WAL.",
+							 NULL,
+							 &MtmDirectPrecommit,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL
+		);
+
+	DefineCustomBoolVariable(
+							 "multimaster.adaptive_commit",
+							 "Skip precommit round of transactions committed while all configured nodes are generation members and connected.",
+							 NULL,
+							 &MtmAdaptiveCommit,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL
+		);
+
 	DefineCustomBoolVariable("multimaster.no_3pc",
 							 "Don't perform 3pc for current xact. Mostly for internal usage, you should really know what you are doing.",
 							 NULL,
@@ -686,6 +745,20 @@ NULL);
 		NULL
 		);
 
+	DefineCustomEnumVariable(
+		"multimaster.stream_compression",
+		"Ask peers to compress replication stream sent to this node",
+		"Takes effect when receiver reconnects.",
+		&MtmStreamCompression,
+		PGL_COMPRESSION_NONE,
+		pglogical_compression_options,
+		PGC_SIGHUP,
+		0,
+		NULL,
+		NULL,
+		NULL
+		);
+
 	for (i = 0; mtm_log_gucs[i].name; i++)
 	{
 		MtmLogGuc *guc = &mtm_log_gucs[i];
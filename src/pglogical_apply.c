@@ -63,6 +63,7 @@
 #include "utils/datum.h"
 #include "utils/builtins.h"
 #include "utils/datetime.h"
+#include "utils/guc_tables.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/snapmgr.h"
@@ -623,6 +624,15 @@ read_rel(StringInfo s, LOCKMODE mode)
 		relnamelen = pq_getmsgbyte(s);
 		rv->relname = (char *) pq_getmsgbytes(s, relnamelen);
 
+		/*
+		 * Sender tells the names only once per connection, and it might
+		 * have been another worker who got them.
+		 */
+		if (nspnamelen == 0 &&
+			!pglogical_relnames_get(remote_relid, &rv->schemaname, &rv->relname))
+			mtm_log(ERROR, "names of remote relation %u are unknown",
+					remote_relid);
+
 		local_relid = RangeVarGetRelidExtended(rv, mode, 0, NULL, NULL);
 		old_context = MemoryContextSwitchTo(TopMemoryContext);
 		pglogical_relid_map_put(remote_relid, local_relid);
@@ -804,23 +814,33 @@ process_remote_commit(StringInfo in,
 					bool		done = false;
 					char	   *xstate;
 
-					MtmBeginSession(origin_node);
-					StartTransactionCommand();
+					/*
+					 * Replier might have already accepted the same decree
+					 * sent directly over dmq; then just ack it once more.
+					 */
+					if (rwctx->gtx->state.status != msg_gtx_state.status ||
+						term_cmp(rwctx->gtx->state.accepted, msg_gtx_state.accepted) != 0 ||
+						term_cmp(rwctx->gtx->state.proposal, msg_gtx_state.proposal) != 0)
+					{
+						MtmBeginSession(origin_node);
+						StartTransactionCommand();
 
-					xstate = serialize_xstate(&xinfo, &msg_gtx_state);
-					done = SetPreparedTransactionState(gid, xstate, false);
-					if (!done)
-						Assert(false);
+						xstate = serialize_xstate(&xinfo, &msg_gtx_state);
+						done = SetPreparedTransactionState(gid, xstate, false);
+						if (!done)
+							Assert(false);
 
-					CommitTransactionCommand();
-					MemoryContextSwitchTo(MtmApplyContext);
-					rwctx->gtx->state = msg_gtx_state;
-					reply_status = msg_gtx_state.status;
-					reply_acc = msg_gtx_state.proposal;
+						CommitTransactionCommand();
+						MemoryContextSwitchTo(MtmApplyContext);
+						rwctx->gtx->state = msg_gtx_state;
+						GlobalTxNoteProposal(msg_gtx_state.proposal);
 
-					mtm_log(MtmTxTrace, "%s precommitted", gid);
+						mtm_log(MtmTxTrace, "%s precommitted", gid);
 
-					MtmEndSession(origin_node, true);
+						MtmEndSession(origin_node, true);
+					}
+					reply_status = msg_gtx_state.status;
+					reply_acc = msg_gtx_state.proposal;
 				}
 
 				if (rwctx->mode == REPLMODE_NORMAL)
@@ -1468,6 +1488,36 @@ process_remote_delete(StringInfo s, Relation rel)
 	CommandCounterIncrement();
 }
 
+/*
+ * Did anything applied so far leave session-level settings behind? Only DDL
+ * (which is executed along with SETs serialized at origin) and, rarely,
+ * replica triggers do that, so usually we can avoid starting a transaction
+ * just to reset them.
+ */
+static bool
+MtmApplySessionChanged(void)
+{
+	struct config_generic **vars;
+	int			nvars;
+	int			i;
+
+	if (GetSessionUserId() != GetAuthenticatedUserId())
+		return true;
+
+	vars = get_guc_variables();
+	nvars = GetNumConfigOptions();
+	for (i = 0; i < nvars; i++)
+	{
+		/*
+		 * Same condition as in ResetAllOptions; session_replication_role
+		 * and friends are set with PGC_S_OVERRIDE and stay.
+		 */
+		if (vars[i]->source > PGC_S_OVERRIDE)
+			return true;
+	}
+	return false;
+}
+
 void
 MtmExecutor(void *work, size_t size, MtmReceiverWorkerContext *rwctx)
 {
@@ -1498,11 +1548,15 @@ MtmExecutor(void *work, size_t size, MtmReceiverWorkerContext *rwctx)
 
 		AcceptInvalidationMessages();
 
-		/* Clear authorization settings */
-		StartTransactionCommand();
-		SetPGVariable("session_authorization", NIL, false);
-		ResetAllOptions();
-		CommitTransactionCommand();
+		/* Clear authorization settings, if previous work changed them */
+		if (MtmApplySessionChanged())
+		{
+			mtm_log(MtmApplyTrace, "resetting session settings");
+			StartTransactionCommand();
+			SetPGVariable("session_authorization", NIL, false);
+			ResetAllOptions();
+			CommitTransactionCommand();
+		}
 
 		if (!receiver_mtm_cfg_valid)
 		{
@@ -0,0 +1,182 @@
+/*-------------------------------------------------------------------------
+ *
+ * pglogical_compress.c
+ *		  Optional compression of the replication stream
+ *
+ * Receiver asks for compression in START_REPLICATION options; walsender
+ * then compresses each CopyData payload it would send (a chunk of up to
+ * OUTPUT_BUFFER_SIZE batched messages) and receiver restores it before
+ * looking inside. lz4 is used if server was built with it, pglz otherwise.
+ *
+ * Portions Copyright (c) 2015-2021, Postgres Professional
+ * Portions Copyright (c) 2015-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  pglogical_compress.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "common/pg_lzcompress.h"
+#include "libpq/pqformat.h"
+
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+
+#include "pglogical_compress.h"
+#include "logger.h"
+
+const struct config_enum_entry pglogical_compression_options[] = {
+	{"off", PGL_COMPRESSION_NONE, false},
+	{"pglz", PGL_COMPRESSION_PGLZ, false},
+#ifdef USE_LZ4
+	{"lz4", PGL_COMPRESSION_LZ4, false},
+#endif
+	{NULL, 0, false}
+};
+
+/*
+ * Method requested by receiver, or PGL_COMPRESSION_NONE if we don't know it.
+ * Receiver which was built with lz4 might ask for it walsender which wasn't;
+ * pglz is understood by everyone then.
+ */
+int
+pglogical_compression_by_name(const char *name)
+{
+	const struct config_enum_entry *entry;
+
+	for (entry = pglogical_compression_options; entry->name; entry++)
+	{
+		if (pg_strcasecmp(entry->name, name) == 0)
+			return entry->val;
+	}
+
+	if (pg_strcasecmp(name, "lz4") == 0)
+		return PGL_COMPRESSION_PGLZ;
+
+	return PGL_COMPRESSION_NONE;
+}
+
+const char *
+pglogical_compression_name(int method)
+{
+	const struct config_enum_entry *entry;
+
+	for (entry = pglogical_compression_options; entry->name; entry++)
+	{
+		if (entry->val == method)
+			return entry->name;
+	}
+	return "unknown";
+}
+
+/*
+ * Append compressed src to dst. Returns false (leaving dst as is) if data
+ * is not compressible enough to bother.
+ */
+bool
+pglogical_compress(int method, const char *src, int srclen, StringInfo dst)
+{
+	int			start = dst->len;
+	int			bound;
+	int			len;
+
+	Assert(method != PGL_COMPRESSION_NONE);
+
+	switch (method)
+	{
+#ifdef USE_LZ4
+		case PGL_COMPRESSION_LZ4:
+			bound = LZ4_compressBound(srclen);
+			break;
+#endif
+		case PGL_COMPRESSION_PGLZ:
+			bound = PGLZ_MAX_OUTPUT(srclen);
+			break;
+		default:
+			elog(ERROR, "unknown stream compression method %d", method);
+	}
+
+	pq_sendbyte(dst, PGL_COMPRESSED_MSG);
+	pq_sendbyte(dst, method);
+	pq_sendint32(dst, srclen);
+	enlargeStringInfo(dst, bound);
+
+	switch (method)
+	{
+#ifdef USE_LZ4
+		case PGL_COMPRESSION_LZ4:
+			len = LZ4_compress_default(src, dst->data + dst->len, srclen, bound);
+			if (len <= 0)
+				len = -1;
+			break;
+#endif
+		default:
+			len = pglz_compress(src, srclen, dst->data + dst->len,
+								PGLZ_strategy_default);
+			break;
+	}
+
+	if (len < 0 || len + PGL_COMPRESSED_HDR_LEN >= srclen)
+	{
+		dst->len = start;
+		dst->data[start] = '\0';
+		return false;
+	}
+
+	dst->len += len;
+	dst->data[dst->len] = '\0';
+	return true;
+}
+
+/*
+ * Replace contents of dst with decompressed 'z' payload src.
+ */
+void
+pglogical_decompress(const char *src, int srclen, StringInfo dst)
+{
+	StringInfoData s;
+	int			method;
+	int			rawlen;
+	int			len;
+
+	s.data = (char *) src;
+	s.len = srclen;
+	s.maxlen = -1;
+	s.cursor = 0;
+
+	if (pq_getmsgbyte(&s) != PGL_COMPRESSED_MSG)
+		mtm_log(ERROR, "not a compressed replication message");
+	method = pq_getmsgbyte(&s);
+	rawlen = pq_getmsgint(&s, 4);
+
+	resetStringInfo(dst);
+	enlargeStringInfo(dst, rawlen);
+
+	switch (method)
+	{
+#ifdef USE_LZ4
+		case PGL_COMPRESSION_LZ4:
+			len = LZ4_decompress_safe(src + s.cursor, dst->data,
+									  srclen - s.cursor, rawlen);
+			break;
+#endif
+		case PGL_COMPRESSION_PGLZ:
+			len = pglz_decompress(src + s.cursor, srclen - s.cursor,
+								  dst->data, rawlen, true);
+			break;
+		default:
+			/* elog, not mtm_log, so that compiler knows we don't get past */
+			elog(ERROR, "unsupported replication stream compression method %d",
+				 method);
+	}
+
+	if (len != rawlen)
+		mtm_log(ERROR, "corrupted compressed replication message: got %d bytes instead of %d",
+				len, rawlen);
+
+	dst->len = rawlen;
+	dst->data[rawlen] = '\0';
+}
@@ -78,7 +78,8 @@ enum
 	PARAM_PG_VERSION,
 	PARAM_FORWARD_CHANGESETS,
 	PARAM_HOOKS_SETUP_FUNCTION,
-	PARAM_NO_TXINFO
+	PARAM_NO_TXINFO,
+	PARAM_COMPRESSION
 }			OutputPluginParamKey;
 
 typedef struct
@@ -107,6 +108,7 @@ static OutputPluginParam param_lookup[] = {
 	{"forward_changesets", PARAM_FORWARD_CHANGESETS},
 	{"hooks.setup_function", PARAM_HOOKS_SETUP_FUNCTION},
 	{"no_txinfo", PARAM_NO_TXINFO},
+	{"mtm_compression", PARAM_COMPRESSION},
 	{NULL, PARAM_UNRECOGNISED}
 };
 
@@ -259,6 +261,11 @@ process_parameters_v1(List *options, PGLogicalOutputData *data)
 				data->client_no_txinfo = DatumGetBool(val);
 				break;
 
+			case PARAM_COMPRESSION:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_STRING);
+				data->client_compression = DatumGetCString(val);
+				break;
+
 			case PARAM_UNRECOGNISED:
 				ereport(DEBUG1,
 						(MTM_ERRMSG("Unrecognized pglogical parameter %s ignored", elem->defname)));
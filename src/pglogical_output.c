@@ -13,6 +13,7 @@
  */
 #include "postgres.h"
 
+#include "pglogical_compress.h"
 #include "pglogical_config.h"
 #include "pglogical_output.h"
 #include "pglogical_proto.h"
@@ -101,24 +102,80 @@ static void send_startup_message(LogicalDecodingContext *ctx,
 
 static bool startup_message_sent = false;
 
+/* stream compression stats, reported at walsender exit */
+static uint64 compress_bytes_raw = 0;
+static uint64 compress_bytes_sent = 0;
+
 #define OUTPUT_BUFFER_SIZE (16*1024*1024)
 
+static void
+MtmOutputCompressionOnExit(int status, Datum arg)
+{
+	mtm_log(ProtoTraceState, "stream compression: " UINT64_FORMAT " bytes sent as " UINT64_FORMAT,
+			compress_bytes_raw, compress_bytes_sent);
+}
+
+/*
+ * Compress what we have written since PrepareWrite, if asked to.
+ */
+static void
+MtmOutputCompress(LogicalDecodingContext *ctx)
+{
+	PGLogicalOutputData *data = (PGLogicalOutputData *) ctx->output_plugin_private;
+	int			len = ctx->out->len - data->payload_start;
+
+	if (data->compression == PGL_COMPRESSION_NONE || len <= 0)
+		return;
+
+	compress_bytes_raw += len;
+	if (len >= PGL_COMPRESS_MIN_SIZE)
+	{
+		resetStringInfo(data->compress_buf);
+		if (pglogical_compress(data->compression,
+							   ctx->out->data + data->payload_start, len,
+							   data->compress_buf))
+		{
+			ctx->out->len = data->payload_start;
+			appendBinaryStringInfo(ctx->out, data->compress_buf->data,
+								   data->compress_buf->len);
+			len = data->compress_buf->len;
+		}
+	}
+	compress_bytes_sent += len;
+}
+
+static void
+MtmOutputDoPrepareWrite(LogicalDecodingContext *ctx, bool last_write)
+{
+	PGLogicalOutputData *data = (PGLogicalOutputData *) ctx->output_plugin_private;
+
+	OutputPluginPrepareWrite(ctx, last_write);
+	data->payload_start = ctx->out->len;
+}
+
+static void
+MtmOutputDoWrite(LogicalDecodingContext *ctx, bool last_write)
+{
+	MtmOutputCompress(ctx);
+	OutputPluginWrite(ctx, last_write);
+}
+
 void
 MtmOutputPluginWrite(LogicalDecodingContext *ctx, bool last_write, bool flush)
 {
 	if (flush)
-		OutputPluginWrite(ctx, last_write);
+		MtmOutputDoWrite(ctx, last_write);
 }
 
 void
 MtmOutputPluginPrepareWrite(LogicalDecodingContext *ctx, bool last_write, bool flush)
 {
 	if (!ctx->prepared_write)
-		OutputPluginPrepareWrite(ctx, last_write);
+		MtmOutputDoPrepareWrite(ctx, last_write);
 	else if (flush || ctx->out->len > OUTPUT_BUFFER_SIZE)
 	{
-		OutputPluginWrite(ctx, false);
-		OutputPluginPrepareWrite(ctx, last_write);
+		MtmOutputDoWrite(ctx, false);
+		MtmOutputDoPrepareWrite(ctx, last_write);
 	}
 }
 
@@ -393,6 +450,21 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt,
 			data->forward_changeset_origins = false;
 		}
 
+		/* Compress the stream if receiver asked and we know how */
+		if (data->client_compression != NULL)
+		{
+			data->compression = pglogical_compression_by_name(data->client_compression);
+			if (data->compression != PGL_COMPRESSION_NONE)
+			{
+				data->compress_buf = makeStringInfo();
+				/* like MtmWalsenderOnExit, shutdown_cb is not reliable */
+				before_shmem_exit(MtmOutputCompressionOnExit, (Datum) 0);
+				mtm_log(ProtoTraceState, "stream compression requested: %s, using: %s",
+						data->client_compression,
+						pglogical_compression_name(data->compression));
+			}
+		}
+
 		if (data->hooks_setup_funcname != NIL || data->api->setup_hooks)
 		{
 
@@ -406,6 +478,17 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt,
 	}
 }
 
+/*
+ * Unlike pg_decode_origin_filter, here we know origin_lsn of the transaction
+ * and let txn filter hook reject it if receiver already has it.
+ */
+static bool
+pg_decode_txn_filtered(PGLogicalOutputData *data, ReorderBufferTXN *txn)
+{
+	return txn->origin_id != InvalidRepOriginId &&
+		!call_txn_filter_hook(data, txn->origin_id, txn->origin_lsn);
+}
+
 /*
  * BEGIN callback
  */
@@ -418,6 +501,10 @@ pg_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
 	if (!startup_message_sent)
 		send_startup_message(ctx, data, false /* can't be last message */ );
 
+	data->skip_txn = pg_decode_txn_filtered(data, txn);
+	if (data->skip_txn)
+		return;
+
 	/* If the record didn't originate locally, send origin info */
 	send_replication_origin &= txn->origin_id != InvalidRepOriginId;
 
@@ -477,6 +564,9 @@ pg_decode_commit_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 {
 	PGLogicalOutputData *data = (PGLogicalOutputData *) ctx->output_plugin_private;
 
+	if (pg_decode_txn_filtered(data, txn))
+		return;
+
 	if (data->api)
 	{
 		MtmOutputPluginPrepareWrite(ctx, true, true);
@@ -491,6 +581,9 @@ pg_decode_prepare_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 {
 	PGLogicalOutputData *data = (PGLogicalOutputData *) ctx->output_plugin_private;
 
+	if (pg_decode_txn_filtered(data, txn))
+		return;
+
 	MtmOutputPluginPrepareWrite(ctx, true, true);
 	pglogical_write_prepare(ctx->out, data, txn, lsn);
 	MtmOutputPluginWrite(ctx, true, true);
@@ -502,6 +595,9 @@ pg_decode_commit_prepared_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn
 {
 	PGLogicalOutputData *data = (PGLogicalOutputData *) ctx->output_plugin_private;
 
+	if (pg_decode_txn_filtered(data, txn))
+		return;
+
 	MtmOutputPluginPrepareWrite(ctx, true, true);
 	pglogical_write_commit_prepared(ctx->out, data, txn, lsn);
 	MtmOutputPluginWrite(ctx, true, true);
@@ -513,6 +609,9 @@ pg_decode_abort_prepared_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 {
 	PGLogicalOutputData *data = (PGLogicalOutputData *) ctx->output_plugin_private;
 
+	if (pg_decode_txn_filtered(data, txn))
+		return;
+
 	MtmOutputPluginPrepareWrite(ctx, true, true);
 	pglogical_write_abort_prepared(ctx->out, data, txn, lsn);
 	MtmOutputPluginWrite(ctx, true, true);
@@ -525,6 +624,9 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	PGLogicalOutputData *data = ctx->output_plugin_private;
 	MemoryContext old;
 
+	if (data->skip_txn)
+		return;
+
 	/* First check the table filter */
 	if (!call_row_filter_hook(data, txn, relation, change) || data->api == NULL)
 		return;
@@ -532,11 +634,10 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	/* Avoid leaking memory by using and resetting our own context */
 	old = MemoryContextSwitchTo(data->context);
 
-	/* TODO: add caching (send only if changed) */
 	if (data->api->write_rel)
 	{
 		MtmOutputPluginPrepareWrite(ctx, false, false);
-		data->api->write_rel(ctx->out, data, relation);
+		data->api->write_rel(ctx->out, ctx, relation);
 		MtmOutputPluginWrite(ctx, false, false);
 	}
 
@@ -589,7 +690,7 @@ pg_decode_origin_filter(LogicalDecodingContext *ctx,
 {
 	PGLogicalOutputData *data = ctx->output_plugin_private;
 
-	if (!call_txn_filter_hook(data, origin_id))
+	if (!call_txn_filter_hook(data, origin_id, InvalidXLogRecPtr))
 	{
 		return true;
 	}
@@ -609,6 +710,9 @@ pg_decode_message(LogicalDecodingContext *ctx,
 {
 	PGLogicalOutputData *data = (PGLogicalOutputData *) ctx->output_plugin_private;
 
+	if (transactional && data->skip_txn)
+		return;
+
 	MtmOutputPluginPrepareWrite(ctx, true, !transactional);
 	data->api->write_message(ctx->out, ctx, lsn, prefix, sz, message);
 	MtmOutputPluginWrite(ctx, true, !transactional);
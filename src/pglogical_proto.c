@@ -43,6 +43,7 @@
 #include "mb/pg_wchar.h"
 
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
@@ -55,7 +56,7 @@
 
 #include "replication/message.h"
 
-#include "pglogical_relid_map.h"
+#include "pglogical_relmetacache.h"
 
 #include "global_tx.h"
 #include "multimaster.h"
@@ -68,11 +69,10 @@ char *walsender_name;
 static int	MtmTransactionRecords;
 static TransactionId MtmCurrentXid;
 static bool DDLInProgress = false;
-static Oid	MtmSenderTID;		/* transaction identifier for WAL sender */
 static Oid	MtmLastRelId;		/* last relation ID sent to the receiver in
 								 * this transaction */
 
-static void pglogical_write_rel(StringInfo out, PGLogicalOutputData *data, Relation rel);
+static void pglogical_write_rel(StringInfo out, LogicalDecodingContext *ctx, Relation rel);
 
 static void pglogical_write_begin(StringInfo out, PGLogicalOutputData *data,
 					  ReorderBufferTXN *txn);
@@ -89,9 +89,8 @@ static void pglogical_write_delete(StringInfo out, PGLogicalOutputData *data,
 
 static void pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 					  Relation rel, HeapTuple tuple);
-static char decide_datum_transfer(Form_pg_attribute att,
-								  Form_pg_type typclass,
-								  bool client_want_binary_basetypes);
+static void pglogical_write_values(StringInfo out, PGLRelMetaCacheEntry *plan,
+					   Datum *values, bool *isnull, bool *unchanged);
 
 static void pglogical_write_caughtup(StringInfo out, PGLogicalOutputData *data,
 						 XLogRecPtr wal_end_ptr);
@@ -99,16 +98,25 @@ static void pglogical_write_caughtup(StringInfo out, PGLogicalOutputData *data,
 
 /*
  * Write relation description to the output stream.
+ *
+ * Schema and table names are sent only once per connection (and again after
+ * relcache invalidation, e.g. after DDL); afterwards the relation is
+ * identified by its Oid alone. Since the transaction which sees the names
+ * might be applied by another parallel worker than the following ones, the
+ * message with names always goes as a separate CopyData, so receiver can
+ * spot it without parsing the whole stream and share the names with its
+ * workers.
  */
 static void
-pglogical_write_rel(StringInfo out, PGLogicalOutputData *data, Relation rel)
+pglogical_write_rel(StringInfo out, LogicalDecodingContext *ctx, Relation rel)
 {
+	PGLogicalOutputData *data = (PGLogicalOutputData *) ctx->output_plugin_private;
+	PGLRelMetaCacheEntry *relmeta;
 	const char *nspname;
 	uint8		nspnamelen;
 	const char *relname;
 	uint8		relnamelen;
 	Oid			relid;
-	Oid			tid;
 
 	if (DDLInProgress)
 	{
@@ -123,36 +131,43 @@ pglogical_write_rel(StringInfo out, PGLogicalOutputData *data, Relation rel)
 
 	MtmLastRelId = relid;
 
-	pq_sendbyte(out, 'R');		/* sending RELATION */
-	pq_sendint(out, relid, sizeof relid);	/* use Oid as relation identifier */
-
-	Assert(MtmSenderTID != InvalidOid);
-	tid = pglogical_relid_map_get(relid);
-	if (tid == MtmSenderTID)
-	{							/* this relation was already sent in this
-								 * transaction */
+	relmeta = pglogical_relmetacache_get(rel, data->client_want_binary_basetypes);
+	if (relmeta->names_sent)
+	{
+		pq_sendbyte(out, 'R');	/* sending RELATION */
+		pq_sendint(out, relid, sizeof relid);	/* use Oid as relation identifier */
 		pq_sendbyte(out, 0);	/* do not need to send relation namespace and
 								 * name in this case */
 		pq_sendbyte(out, 0);
+		return;
 	}
-	else
-	{
-		pglogical_relid_map_put(relid, MtmSenderTID);
-		nspname = get_namespace_name(rel->rd_rel->relnamespace);
-		if (nspname == NULL)
-			elog(ERROR, "cache lookup failed for namespace %u",
-				 rel->rd_rel->relnamespace);
-		nspnamelen = strlen(nspname) + 1;
 
-		relname = NameStr(rel->rd_rel->relname);
-		relnamelen = strlen(relname) + 1;
+	nspname = get_namespace_name(rel->rd_rel->relnamespace);
+	if (nspname == NULL)
+		elog(ERROR, "cache lookup failed for namespace %u",
+			 rel->rd_rel->relnamespace);
+	nspnamelen = strlen(nspname) + 1;
 
-		pq_sendbyte(out, nspnamelen);	/* schema name length */
-		pq_sendbytes(out, nspname, nspnamelen);
+	relname = NameStr(rel->rd_rel->relname);
+	relnamelen = strlen(relname) + 1;
 
-		pq_sendbyte(out, relnamelen);	/* table name length */
-		pq_sendbytes(out, relname, relnamelen);
-	}
+	/* finish whatever is pending and start a new message */
+	MtmOutputPluginPrepareWrite(ctx, false, true);
+
+	pq_sendbyte(ctx->out, 'R');	/* sending RELATION */
+	pq_sendint(ctx->out, relid, sizeof relid);	/* use Oid as relation identifier */
+
+	pq_sendbyte(ctx->out, nspnamelen);	/* schema name length */
+	pq_sendbytes(ctx->out, nspname, nspnamelen);
+
+	pq_sendbyte(ctx->out, relnamelen);	/* table name length */
+	pq_sendbytes(ctx->out, relname, relnamelen);
+
+	MtmOutputPluginWrite(ctx, false, true);
+	/* and let the caller continue with the fresh one */
+	MtmOutputPluginPrepareWrite(ctx, false, false);
+
+	relmeta->names_sent = true;
 }
 
 /*
@@ -166,12 +181,6 @@ pglogical_write_begin(StringInfo out, PGLogicalOutputData *data,
 
 	Assert(hooks_data->is_recovery || txn->origin_id == InvalidRepOriginId);
 
-	if (++MtmSenderTID == InvalidOid)
-	{
-		pglogical_relid_map_reset();
-		MtmSenderTID += 1;		/* skip InvalidOid */
-	}
-
 	MtmLastRelId = InvalidOid;
 	MtmCurrentXid = txn->xid;
 	DDLInProgress = false;
@@ -193,7 +202,7 @@ pglogical_seq_nextval(StringInfo out, LogicalDecodingContext *ctx, MtmSeqPositio
 {
 	Relation	rel = RelationIdGetRelation(pos->seqid);
 
-	pglogical_write_rel(out, ctx->output_plugin_private, rel);
+	pglogical_write_rel(out, ctx, rel);
 	RelationClose(rel);
 	pq_sendbyte(out, 'N');
 	pq_sendint64(out, pos->next);
@@ -213,7 +222,7 @@ pglogical_broadcast_table(StringInfo out, LogicalDecodingContext *ctx, MtmCopyRe
 
 		rel = table_open(copy->sourceTable, ShareLock);
 
-		pglogical_write_rel(out, ctx->output_plugin_private, rel);
+		pglogical_write_rel(out, ctx, rel);
 
 		pq_sendbyte(out, '0');
 
@@ -342,11 +351,27 @@ pglogical_write_insert(StringInfo out, PGLogicalOutputData *data,
 
 /*
  * Write UPDATE to the output stream.
+ *
+ * If the whole old tuple is available (REPLICA IDENTITY FULL) we send only
+ * the columns which actually changed, the rest go as 'u' just like unchanged
+ * toasted values and receiver keeps them from its local row. In this case the
+ * old tuple is used by receiver only to find the row, so if the table has
+ * primary key (that's what receiver will search by) only key columns are
+ * sent in it.
  */
 static void
 pglogical_write_update(StringInfo out, PGLogicalOutputData *data,
 					   Relation rel, HeapTuple oldtuple, HeapTuple newtuple)
 {
+	TupleDesc	desc;
+	PGLRelMetaCacheEntry *plan;
+	Datum		old_values[MaxTupleAttributeNumber];
+	bool		old_isnull[MaxTupleAttributeNumber];
+	Datum		new_values[MaxTupleAttributeNumber];
+	bool		new_isnull[MaxTupleAttributeNumber];
+	bool		unchanged[MaxTupleAttributeNumber];
+	int			i;
+
 	if (DDLInProgress)
 	{
 		mtm_log(ProtoTraceFilter, "pglogical_write_update filtered DDLInProgress");
@@ -356,15 +381,49 @@ pglogical_write_update(StringInfo out, PGLogicalOutputData *data,
 	MtmTransactionRecords += 1;
 
 	pq_sendbyte(out, 'U');		/* action UPDATE */
-	/* FIXME support whole tuple (O tuple type) */
-	if (oldtuple != NULL)
+
+	if (oldtuple == NULL || rel->rd_rel->relreplident != REPLICA_IDENTITY_FULL)
+	{
+		/* FIXME support whole tuple (O tuple type) */
+		if (oldtuple != NULL)
+		{
+			pq_sendbyte(out, 'K');	/* old key follows */
+			pglogical_write_tuple(out, data, rel, oldtuple);
+		}
+
+		pq_sendbyte(out, 'N');	/* new tuple follows */
+		pglogical_write_tuple(out, data, rel, newtuple);
+		return;
+	}
+
+	desc = RelationGetDescr(rel);
+	plan = pglogical_relmetacache_get(rel, data->client_want_binary_basetypes);
+
+	heap_deform_tuple(oldtuple, desc, old_values, old_isnull);
+	heap_deform_tuple(newtuple, desc, new_values, new_isnull);
+
+	/* old key: with pkey lookup on receiver non-key columns are not needed */
+	for (i = 0; i < plan->nliveatts; i++)
+		unchanged[plan->atts[i].attidx] = plan->has_pkey && !plan->atts[i].is_key;
+
+	pq_sendbyte(out, 'K');		/* old key follows */
+	pglogical_write_values(out, plan, old_values, old_isnull, unchanged);
+
+	/* new tuple: only the columns which differ from the old ones */
+	for (i = 0; i < plan->nliveatts; i++)
 	{
-		pq_sendbyte(out, 'K');	/* old key follows */
-		pglogical_write_tuple(out, data, rel, oldtuple);
+		PGLAttEncoding *enc = &plan->atts[i];
+		int			j = enc->attidx;
+
+		if (old_isnull[j] || new_isnull[j])
+			unchanged[j] = old_isnull[j] && new_isnull[j];
+		else
+			unchanged[j] = datumIsEqual(old_values[j], new_values[j],
+										enc->attbyval, enc->attlen);
 	}
 
 	pq_sendbyte(out, 'N');		/* new tuple follows */
-	pglogical_write_tuple(out, data, rel, newtuple);
+	pglogical_write_values(out, plan, new_values, new_isnull, unchanged);
 }
 
 /*
@@ -394,32 +453,38 @@ write_startup_message(StringInfo out, List *msg)
 {
 }
 
+static int
+MtmOriginToNodeId(MtmDecoderPrivate *private, RepOriginId origin_id)
+{
+	int			i;
+
+	for (i = 0; i < private->cfg->n_nodes; i++)
+	{
+		if (private->cfg->nodes[i].node_id == private->cfg->my_node_id)
+			continue;
+
+		if (private->cfg->nodes[i].origin_id == origin_id)
+			return private->cfg->nodes[i].node_id;
+	}
+	return MtmInvalidNodeId;
+}
+
 static void
 send_node_id(StringInfo out, ReorderBufferTXN *txn, MtmDecoderPrivate *private)
 {
 	if (txn->origin_id != InvalidRepOriginId)
 	{
-		int			i;
-
-		for (i = 0; i < private->cfg->n_nodes; i++)
-		{
-			if (private->cfg->nodes[i].node_id == private->cfg->my_node_id)
-				continue;
+		int			node_id = MtmOriginToNodeId(private, txn->origin_id);
 
-			if (private->cfg->nodes[i].origin_id == txn->origin_id)
-			{
-				pq_sendbyte(out, private->cfg->nodes[i].node_id);
-				return;
-			}
-		}
 		/*
 		 * Could happen if node was dropped. Might lead to skipping dropped
 		 * node xacts on some lagged node, but who ever said we support
 		 * membership changes under load? Such records will be dropped by
 		 * filter on receiver side.
 		 */
-		mtm_log(WARNING, "failed to map origin %d", txn->origin_id);
-		pq_sendbyte(out, MtmInvalidNodeId);
+		if (node_id == MtmInvalidNodeId)
+			mtm_log(WARNING, "failed to map origin %d", txn->origin_id);
+		pq_sendbyte(out, node_id);
 	}
 	else
 	{
@@ -458,6 +523,17 @@ pglogical_write_prepare(StringInfo out, PGLogicalOutputData *data,
 		{
 			return;
 		}
+
+		/*
+		 * Replier writes precommit received directly from the coordinator
+		 * (see handle_2a) without origin; it is not ours to stream, the
+		 * coordinator does that itself.
+		 */
+		if (txn->origin_id == InvalidRepOriginId &&
+			xinfo.coordinator != hooks_data->cfg->my_node_id)
+		{
+			return;
+		}
 	}
 
 	/* send the event fields */
@@ -600,8 +676,7 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 	TupleDesc	desc;
 	Datum		values[MaxTupleAttributeNumber];
 	bool		isnull[MaxTupleAttributeNumber];
-	int			i;
-	uint16		nliveatts = 0;
+	PGLRelMetaCacheEntry *plan;
 
 	if (DDLInProgress)
 	{
@@ -610,88 +685,89 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 	}
 
 	desc = RelationGetDescr(rel);
-
-	pq_sendbyte(out, 'T');		/* sending TUPLE */
-
-	for (i = 0; i < desc->natts; i++)
-	{
-		if (TupleDescAttr(desc, i)->attisdropped)
-			continue;
-		nliveatts++;
-	}
-	pq_sendint(out, nliveatts, 2);
+	plan = pglogical_relmetacache_get(rel, data->client_want_binary_basetypes);
 
 	/* try to allocate enough memory from the get go */
-	enlargeStringInfo(out, tuple->t_len +
-					  nliveatts * (1 + 4));
+	enlargeStringInfo(out, 1 + 2 + tuple->t_len +
+					  plan->nliveatts * (1 + 4));
 
 	/*
-	 * XXX: should this prove to be a relevant bottleneck, it might be
-	 * interesting to inline heap_deform_tuple() here, we don't actually need
-	 * the information in the form we get from it.
+	 * Per-column type lookups are done once per relation by the plan above,
+	 * which was the dominating cost here. heap_deform_tuple() itself is kept
+	 * as is: a hand-rolled deform loop would have to duplicate its handling
+	 * of attcacheoff and of missing (atthasmissing) attributes for a small
+	 * gain.
 	 */
 	heap_deform_tuple(tuple, desc, values, isnull);
 
-	for (i = 0; i < desc->natts; i++)
+	pglogical_write_values(out, plan, values, isnull, NULL);
+}
+
+/*
+ * Write deformed tuple. Columns marked in unchanged (if given) are sent as
+ * 'u', i.e. receiver must keep its own value.
+ */
+static void
+pglogical_write_values(StringInfo out, PGLRelMetaCacheEntry *plan,
+					   Datum *values, bool *isnull, bool *unchanged)
+{
+	int			i;
+
+	pq_sendbyte(out, 'T');		/* sending TUPLE */
+	pq_sendint(out, plan->nliveatts, 2);
+
+	for (i = 0; i < plan->nliveatts; i++)
 	{
-		HeapTuple	typtup;
-		Form_pg_type typclass;
-		Form_pg_attribute att = TupleDescAttr(desc, i);
-		char		transfer_type;
+		PGLAttEncoding *enc = &plan->atts[i];
+		Datum		value = values[enc->attidx];
 
-		/* skip dropped columns */
-		if (att->attisdropped)
+		if (unchanged != NULL && unchanged[enc->attidx])
+		{
+			pq_sendbyte(out, 'u');	/* unchanged column */
 			continue;
-
-		if (isnull[i])
+		}
+		else if (isnull[enc->attidx])
 		{
 			pq_sendbyte(out, 'n');	/* null column */
 			continue;
 		}
-		else if (att->attlen == -1 && VARATT_IS_EXTERNAL_ONDISK(values[i]))
+		else if (enc->attlen == -1 && VARATT_IS_EXTERNAL_ONDISK(value))
 		{
 			pq_sendbyte(out, 'u');	/* unchanged toast column */
 			continue;
 		}
 
-		typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(att->atttypid));
-		if (!HeapTupleIsValid(typtup))
-			elog(ERROR, "cache lookup failed for type %u", att->atttypid);
-		typclass = (Form_pg_type) GETSTRUCT(typtup);
-
-		transfer_type = decide_datum_transfer(att, typclass,
-											  data->client_want_binary_basetypes);
-		pq_sendbyte(out, transfer_type);
-		switch (transfer_type)
+		pq_sendbyte(out, enc->transfer_type);
+		switch (enc->transfer_type)
 		{
 			case 'b':			/* internal-format binary data follows */
 
 				/* pass by value */
-				if (att->attbyval)
+				if (enc->attbyval)
 				{
-					pq_sendint(out, att->attlen, 4);	/* length */
+					pq_sendint(out, enc->attlen, 4);	/* length */
 
-					enlargeStringInfo(out, att->attlen);
-					store_att_byval(out->data + out->len, values[i],
-									att->attlen);
-					out->len += att->attlen;
+					enlargeStringInfo(out, enc->attlen);
+					store_att_byval(out->data + out->len, value,
+									enc->attlen);
+					out->len += enc->attlen;
 					out->data[out->len] = '\0';
 				}
 				/* fixed length non-varlena pass-by-reference type */
-				else if (att->attlen > 0)
+				else if (enc->attlen > 0)
 				{
-					pq_sendint(out, att->attlen, 4);	/* length */
+					pq_sendint(out, enc->attlen, 4);	/* length */
 
-					appendBinaryStringInfo(out, DatumGetPointer(values[i]),
-										   att->attlen);
+					appendBinaryStringInfo(out, DatumGetPointer(value),
+										   enc->attlen);
 				}
 				/* varlena type */
-				else if (att->attlen == -1)
+				else if (enc->attlen == -1)
 				{
-					char	   *data = DatumGetPointer(values[i]);
+					char	   *data = DatumGetPointer(value);
 
 					/* send indirect datums inline */
-					if (VARATT_IS_EXTERNAL_INDIRECT(values[i]))
+					if (VARATT_IS_EXTERNAL_INDIRECT(value))
 					{
 						struct varatt_indirect redirect;
 
@@ -715,38 +791,14 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 					char	   *outputstr;
 					int			len;
 
-					outputstr = OidOutputFunctionCall(typclass->typoutput,
-													  values[i]);
+					outputstr = OutputFunctionCall(&enc->typoutput, value);
 					len = strlen(outputstr) + 1;
 					pq_sendint(out, len, 4);	/* length */
 					appendBinaryStringInfo(out, outputstr, len);	/* data */
 					pfree(outputstr);
 				}
 		}
-
-		ReleaseSysCache(typtup);
-	}
-}
-
-/*
- * Make the executive decision about which protocol to use.
- */
-static char
-decide_datum_transfer(Form_pg_attribute att, Form_pg_type typclass,
-					  bool client_want_binary_basetypes)
-{
-	/*
-	 * Use the binary protocol, if allowed, for builtin & plain datatypes.
-	 */
-	if (client_want_binary_basetypes &&
-		typclass->typtype == 'b' &&
-		att->atttypid < FirstNormalObjectId &&
-		typclass->typelem == InvalidOid)
-	{
-		return 'b';
 	}
-
-	return 't';
 }
 
 static void
@@ -766,6 +818,30 @@ MtmWalsenderOnExit(int status, Datum arg)
 	mtm_log(ProtoTraceState, "walsender to node %d exited", receiver_node_id);
 }
 
+/*
+ * Parse "node_id:lsn,..." list sent by receiver in recovery mode.
+ */
+static void
+MtmParseRecoveryFilter(MtmDecoderPrivate *hooks_data, char *filter)
+{
+	char	   *tok;
+	char	   *saveptr;
+
+	for (tok = strtok_r(filter, ",", &saveptr); tok != NULL;
+		 tok = strtok_r(NULL, ",", &saveptr))
+	{
+		int			node_id;
+		uint32		hi;
+		uint32		lo;
+
+		if (sscanf(tok, "%d:%X/%X", &node_id, &hi, &lo) != 3 ||
+			node_id < 1 || node_id > MTM_MAX_NODES)
+			mtm_log(ERROR, "invalid recovery filter item \"%s\"", tok);
+
+		hooks_data->recovery_filter_lsn[node_id - 1] = ((uint64) hi) << 32 | lo;
+	}
+}
+
 static void
 MtmReplicationStartupHook(struct PGLogicalStartupHookArgs *args)
 {
@@ -825,6 +901,11 @@ MtmReplicationStartupHook(struct PGLogicalStartupHookArgs *args)
 				mtm_log(ERROR, "Replication mode is not specified");
 			}
 		}
+		else if (strcmp("mtm_recovery_filter", elem->defname) == 0)
+		{
+			if (elem->arg != NULL && strVal(elem->arg) != NULL)
+				MtmParseRecoveryFilter(hooks_data, strVal(elem->arg));
+		}
 	}
 
 	mtm_log(ProtoTraceState,
@@ -836,6 +917,7 @@ MtmReplicationStartupHook(struct PGLogicalStartupHookArgs *args)
 static void
 MtmReplicationShutdownHook(struct PGLogicalShutdownHookArgs *args)
 {
+	pglogical_relmetacache_destroy();
 }
 
 /*
@@ -860,6 +942,33 @@ MtmReplicationTxnFilterHook(struct PGLogicalTxnFilterArgs *args)
 	bool		res = (args->origin_id == InvalidRepOriginId ||
 					   hooks_data->is_recovery);
 
+	/*
+	 * In recovery, don't bother to decode and send what receiver would throw
+	 * away anyway in MtmFilterTransaction: its own transactions and those
+	 * it already has according to its syncpoints.
+	 */
+	if (res && hooks_data->is_recovery && args->origin_id != InvalidRepOriginId)
+	{
+		int			origin_node = MtmOriginToNodeId(hooks_data, args->origin_id);
+
+		if (origin_node == hooks_data->receiver_node_id)
+		{
+			mtm_log(ProtoTraceFilter, "skipping transaction of origin %d: it is receiver's own",
+					origin_node);
+			return false;
+		}
+
+		if (origin_node != MtmInvalidNodeId &&
+			args->origin_lsn != InvalidXLogRecPtr &&
+			args->origin_lsn <= hooks_data->recovery_filter_lsn[origin_node - 1])
+		{
+			mtm_log(ProtoTraceFilter, "skipping transaction of origin %d at " LSN_FMT ": receiver has it up to " LSN_FMT,
+					origin_node, args->origin_lsn,
+					hooks_data->recovery_filter_lsn[origin_node - 1]);
+			return false;
+		}
+	}
+
 	return res;
 }
 
@@ -57,6 +57,8 @@
 #include "syncpoint.h"
 #include "global_tx.h"
 #include "mtm_utils.h"
+#include "pglogical_compress.h"
+#include "pglogical_relid_map.h"
 
 #define ERRCODE_DUPLICATE_OBJECT_STR  "42710"
 
@@ -100,6 +102,7 @@ bool		receiver_mtm_cfg_valid;
 static int64 fe_recvint64(char *buf);
 
 static void MtmMaybeAdvanceSlot(MtmReceiverContext *rctx, char *conninfo);
+static void MtmPublishRelationNames(char *record, int size);
 
 void		pglogical_receiver_main(Datum main_arg);
 
@@ -253,6 +256,33 @@ MtmExecute(void *work, int size, MtmReceiverWorkerContext *rwctx, bool no_pool)
 
 }
 
+/*
+ * Put relation names from 'R' message into the table shared with workers.
+ */
+static void
+MtmPublishRelationNames(char *record, int size)
+{
+	StringInfoData s;
+	Oid			remote_relid;
+	int			nspnamelen;
+	const char *nspname;
+	int			relnamelen;
+	const char *relname;
+
+	s.data = record;
+	s.len = size;
+	s.maxlen = -1;
+	s.cursor = 1;				/* skip 'R' */
+
+	remote_relid = pq_getmsgint(&s, 4);
+	nspnamelen = pq_getmsgbyte(&s);
+	nspname = pq_getmsgbytes(&s, nspnamelen);
+	relnamelen = pq_getmsgbyte(&s);
+	relname = pq_getmsgbytes(&s, relnamelen);
+
+	pglogical_relnames_put(remote_relid, nspname, relname);
+}
+
 /*
  * Filter received transactions at destination side.
  * This function is executed by receiver,
@@ -569,6 +599,8 @@ pglogical_receiver_main(Datum main_arg)
 
 	int			spill_file = -1;
 	StringInfoData spill_info;
+	StringInfoData decompressed;
+	StringInfoData recovery_filter;
 	static PortalData fakePortal;
 
 	Oid			db_id;
@@ -598,6 +630,8 @@ pglogical_receiver_main(Datum main_arg)
 	ByteBufferAlloc(&buf);
 
 	initStringInfo(&spill_info);
+	initStringInfo(&decompressed);
+	initStringInfo(&recovery_filter);
 
 	/* Register functions for SIGTERM/SIGHUP management */
 	pqsignal(SIGHUP, SignalHandlerForConfigReload);
@@ -833,17 +867,46 @@ pglogical_receiver_main(Datum main_arg)
 
 		Assert(filter_map && spvector);
 
+		/*
+		 * In recovery sender would push through a lot of transactions we
+		 * already have; tell it about our syncpoints so it could skip them
+		 * without decoding. This only duplicates checks done in
+		 * MtmFilterTransaction, which stays authoritative.
+		 */
+		resetStringInfo(&recovery_filter);
+		if (rctx->w.mode == REPLMODE_RECOVERY)
+		{
+			int			i;
+
+			for (i = 0; i < MTM_MAX_NODES; i++)
+			{
+				if (i + 1 == sender ||
+					spvector[i].local_lsn == InvalidXLogRecPtr ||
+					spvector[i].origin_lsn == InvalidXLogRecPtr)
+					continue;
+				appendStringInfo(&recovery_filter, "%s%d:%X/%X",
+								 recovery_filter.len > 0 ? "," : "",
+								 i + 1,
+								 (uint32) (spvector[i].origin_lsn >> 32),
+								 (uint32) spvector[i].origin_lsn);
+			}
+		}
+
 		appendPQExpBuffer(query, "START_REPLICATION SLOT \"%s\" LOGICAL %x/%x ("
 						  "\"startup_params_format\" '1',"
 						  "\"max_proto_version\" '1',"
 						  "\"min_proto_version\" '1',"
 						  "\"forward_changesets\" '1',"
 						  "\"binary.want_binary_basetypes\" '%d',"
+						  "\"mtm_compression\" '%s',"
+						  "\"mtm_recovery_filter\" '%s',"
 						  "\"mtm_replication_mode\" '%s')",
 						  psprintf(MULTIMASTER_SLOT_PATTERN, receiver_mtm_cfg->my_node_id),
 						  (uint32) (remote_start >> 32),
 						  (uint32) remote_start,
 						  MtmBinaryBasetypes,
+						  pglogical_compression_name(MtmStreamCompression),
+						  recovery_filter.data,
 						  MtmReplicationModeMnem[rctx->w.mode]
 			);
 		conn = ((MyWalReceiverConn *) rctx->wrconn)->streamConn;
@@ -969,6 +1032,13 @@ pglogical_receiver_main(Datum main_arg)
 
 					stmt = copybuf + hdr_len;
 
+					if (stmt[0] == PGL_COMPRESSED_MSG)
+					{
+						pglogical_decompress(stmt, msg_len, &decompressed);
+						stmt = decompressed.data;
+						msg_len = decompressed.len;
+					}
+
 					/*
 					 * Non-tx logical messages are normally short and don't
 					 * need spill support.
@@ -1032,6 +1102,14 @@ pglogical_receiver_main(Datum main_arg)
 						ByteBufferReset(&buf);
 					}
 
+					/*
+					 * Relation names come only once per connection in a
+					 * message of their own; share them with the workers, any
+					 * of which might need them later.
+					 */
+					if (stmt[0] == 'R' && msg_len > 1 + 4 + 1 && stmt[5] != 0)
+						MtmPublishRelationNames(stmt, msg_len);
+
 					ByteBufferAppend(&buf, stmt, msg_len);
 					if (stmt[0] == 'C') /* commit */
 					{
@@ -13,11 +13,24 @@
  *-------------------------------------------------------------------------
  */
 #include "postgres.h"
+#include "storage/lwlock.h"
+#include "utils/builtins.h"
 #include "utils/hsearch.h"
 #include "pglogical_relid_map.h"
 
 static HTAB *relid_map;
 
+static dsa_area *relnames_area;
+static dshash_table *relnames;
+
+static const dshash_parameters relnames_params = {
+	sizeof(Oid),
+	sizeof(PGLRelNamesEntry),
+	dshash_memcmp,
+	dshash_memhash,
+	0							/* tranche id is set at runtime */
+};
+
 static void
 pglogical_relid_map_init(void)
 {
@@ -74,3 +87,79 @@ pglogical_relid_map_reset(void)
 		relid_map = NULL;
 	}
 }
+
+/*
+ * Create shared relation names table; called by receiver before spinning
+ * up the workers.
+ */
+void
+pglogical_relnames_create(int tranche_id, dsa_handle *area_handle,
+						  dshash_table_handle *table_handle)
+{
+	dshash_parameters params = relnames_params;
+
+	Assert(relnames == NULL);
+
+	LWLockRegisterTranche(tranche_id, "MTM_RELNAMES");
+	params.tranche_id = tranche_id;
+
+	relnames_area = dsa_create(tranche_id);
+	dsa_pin_mapping(relnames_area);
+	relnames = dshash_create(relnames_area, &params, NULL);
+
+	*area_handle = dsa_get_handle(relnames_area);
+	*table_handle = dshash_get_hash_table_handle(relnames);
+}
+
+void
+pglogical_relnames_attach(int tranche_id, dsa_handle area_handle,
+						  dshash_table_handle table_handle)
+{
+	dshash_parameters params = relnames_params;
+
+	Assert(relnames == NULL);
+
+	LWLockRegisterTranche(tranche_id, "MTM_RELNAMES");
+	params.tranche_id = tranche_id;
+
+	relnames_area = dsa_attach(area_handle);
+	dsa_pin_mapping(relnames_area);
+	relnames = dshash_attach(relnames_area, &params, table_handle, NULL);
+}
+
+void
+pglogical_relnames_put(Oid remote_relid, const char *nspname,
+					   const char *relname)
+{
+	PGLRelNamesEntry *entry;
+	bool		found;
+
+	Assert(relnames != NULL);
+
+	entry = dshash_find_or_insert(relnames, &remote_relid, &found);
+	namestrcpy(&entry->nspname, nspname);
+	namestrcpy(&entry->relname, relname);
+	dshash_release_lock(relnames, entry);
+}
+
+/*
+ * Returns palloc'ed copies of names, or false if sender haven't told them
+ * yet.
+ */
+bool
+pglogical_relnames_get(Oid remote_relid, char **nspname, char **relname)
+{
+	PGLRelNamesEntry *entry;
+
+	if (relnames == NULL)
+		return false;
+
+	entry = dshash_find(relnames, &remote_relid, false);
+	if (entry == NULL)
+		return false;
+
+	*nspname = pstrdup(NameStr(entry->nspname));
+	*relname = pstrdup(NameStr(entry->relname));
+	dshash_release_lock(relnames, entry);
+	return true;
+}
@@ -0,0 +1,261 @@
+/*-------------------------------------------------------------------------
+ *
+ * pglogical_relmetacache.c
+ *		  Per-relation metadata cached by the output plugin
+ *
+ * Walsender encodes every decoded row of the relation in the same way, so
+ * the per-column decisions (which columns are live, binary or text transfer,
+ * which output function to call) are made once and kept here until relcache
+ * or type cache invalidation says they might be stale. We also remember
+ * whether relation names were already sent over this connection.
+ *
+ * Portions Copyright (c) 2015-2021, Postgres Professional
+ * Portions Copyright (c) 2015-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  pglogical_relmetacache.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "access/sysattr.h"
+#include "access/transam.h"
+#include "catalog/pg_type.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "nodes/bitmapset.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+#include "utils/syscache.h"
+
+#include "pglogical_relmetacache.h"
+
+static HTAB *RelMetaCache = NULL;
+static MemoryContext RelMetaCacheContext = NULL;
+static bool callbacks_registered = false;
+
+static char decide_datum_transfer(Form_pg_attribute att,
+								  Form_pg_type typclass,
+								  bool client_want_binary_basetypes);
+
+/*
+ * Relation changed: forget its plan, or all of them if relid is invalid.
+ */
+static void
+relmetacache_relcache_cb(Datum arg, Oid relid)
+{
+	PGLRelMetaCacheEntry *entry;
+
+	if (RelMetaCache == NULL)
+		return;
+
+	if (relid == InvalidOid)
+	{
+		HASH_SEQ_STATUS status;
+
+		hash_seq_init(&status, RelMetaCache);
+		while ((entry = (PGLRelMetaCacheEntry *) hash_seq_search(&status)) != NULL)
+			entry->is_valid = false;
+	}
+	else
+	{
+		entry = (PGLRelMetaCacheEntry *) hash_search(RelMetaCache, &relid,
+													 HASH_FIND, NULL);
+		if (entry != NULL)
+			entry->is_valid = false;
+	}
+}
+
+/*
+ * Some type changed: forget plans having columns of it, or all of them if
+ * hashvalue is 0 (full reset).
+ */
+static void
+relmetacache_type_cb(Datum arg, int cacheid, uint32 hashvalue)
+{
+	HASH_SEQ_STATUS status;
+	PGLRelMetaCacheEntry *entry;
+
+	if (RelMetaCache == NULL)
+		return;
+
+	hash_seq_init(&status, RelMetaCache);
+	while ((entry = (PGLRelMetaCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		int			i;
+
+		if (!entry->is_valid)
+			continue;
+		if (hashvalue == 0)
+		{
+			entry->is_valid = false;
+			continue;
+		}
+		for (i = 0; i < entry->nliveatts; i++)
+		{
+			if (entry->atts[i].typhashvalue == hashvalue)
+			{
+				entry->is_valid = false;
+				break;
+			}
+		}
+	}
+}
+
+static void
+relmetacache_init(void)
+{
+	HASHCTL		ctl;
+
+	Assert(RelMetaCache == NULL);
+
+	RelMetaCacheContext = AllocSetContextCreate(CacheMemoryContext,
+												"pglogical relmetacache",
+												ALLOCSET_SMALL_SIZES);
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(Oid);
+	ctl.entrysize = sizeof(PGLRelMetaCacheEntry);
+	ctl.hcxt = RelMetaCacheContext;
+	RelMetaCache = hash_create("pglogical relmetacache",
+							   RELMETACACHE_INITIAL_SIZE, &ctl,
+							   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	/* there is no way to unregister callbacks, so do it once per process */
+	if (!callbacks_registered)
+	{
+		CacheRegisterRelcacheCallback(relmetacache_relcache_cb, (Datum) 0);
+		CacheRegisterSyscacheCallback(TYPEOID, relmetacache_type_cb, (Datum) 0);
+		callbacks_registered = true;
+	}
+}
+
+/*
+ * (Re)build the encoding plan of rel into entry.
+ */
+static void
+relmetacache_build(PGLRelMetaCacheEntry *entry, Relation rel, bool want_binary)
+{
+	TupleDesc	desc = RelationGetDescr(rel);
+	Bitmapset  *pkattrs;
+	int			i;
+
+	/* everything of the previous plan, output functions included, goes */
+	if (entry->cxt == NULL)
+		entry->cxt = AllocSetContextCreate(RelMetaCacheContext,
+										   "pglogical relmetacache entry",
+										   ALLOCSET_SMALL_SIZES);
+	else
+		MemoryContextReset(entry->cxt);
+	entry->atts = NULL;
+
+	/* stays so if we ERROR out halfway */
+	entry->is_valid = false;
+	entry->nliveatts = 0;
+	entry->want_binary = want_binary;
+	/* relation might have been renamed, so tell the names again */
+	entry->names_sent = false;
+	pkattrs = RelationGetIndexAttrBitmap(rel, INDEX_ATTR_BITMAP_PRIMARY_KEY);
+	entry->has_pkey = !bms_is_empty(pkattrs);
+	entry->atts = MemoryContextAllocZero(entry->cxt,
+										 Max(desc->natts, 1) * sizeof(PGLAttEncoding));
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Form_pg_attribute att = TupleDescAttr(desc, i);
+		PGLAttEncoding *enc;
+		HeapTuple	typtup;
+		Form_pg_type typclass;
+
+		/* skip dropped columns */
+		if (att->attisdropped)
+			continue;
+
+		enc = &entry->atts[entry->nliveatts++];
+		enc->attidx = i;
+		enc->attlen = att->attlen;
+		enc->attbyval = att->attbyval;
+		enc->is_key = bms_is_member(att->attnum - FirstLowInvalidHeapAttributeNumber,
+									pkattrs);
+		enc->typhashvalue = GetSysCacheHashValue1(TYPEOID,
+												  ObjectIdGetDatum(att->atttypid));
+
+		typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(att->atttypid));
+		if (!HeapTupleIsValid(typtup))
+			elog(ERROR, "cache lookup failed for type %u", att->atttypid);
+		typclass = (Form_pg_type) GETSTRUCT(typtup);
+
+		enc->transfer_type = decide_datum_transfer(att, typclass, want_binary);
+		if (enc->transfer_type == 't')
+			fmgr_info_cxt(typclass->typoutput, &enc->typoutput, entry->cxt);
+
+		ReleaseSysCache(typtup);
+	}
+
+	bms_free(pkattrs);
+	entry->is_valid = true;
+}
+
+/*
+ * Get encoding plan of the relation, building it if needed.
+ */
+PGLRelMetaCacheEntry *
+pglogical_relmetacache_get(Relation rel, bool want_binary)
+{
+	Oid			relid = RelationGetRelid(rel);
+	PGLRelMetaCacheEntry *entry;
+	bool		found;
+
+	if (RelMetaCache == NULL)
+		relmetacache_init();
+
+	entry = (PGLRelMetaCacheEntry *) hash_search(RelMetaCache, &relid,
+												 HASH_ENTER, &found);
+	if (!found)
+	{
+		entry->is_valid = false;
+		entry->cxt = NULL;
+		entry->atts = NULL;
+	}
+
+	if (!entry->is_valid || entry->want_binary != want_binary)
+		relmetacache_build(entry, rel, want_binary);
+
+	return entry;
+}
+
+void
+pglogical_relmetacache_destroy(void)
+{
+	if (RelMetaCache != NULL)
+	{
+		hash_destroy(RelMetaCache);
+		RelMetaCache = NULL;
+		MemoryContextDelete(RelMetaCacheContext);
+		RelMetaCacheContext = NULL;
+	}
+}
+
+/*
+ * Make the executive decision about which protocol to use.
+ */
+static char
+decide_datum_transfer(Form_pg_attribute att, Form_pg_type typclass,
+					  bool client_want_binary_basetypes)
+{
+	/*
+	 * Use the binary protocol, if allowed, for builtin & plain datatypes.
+	 */
+	if (client_want_binary_basetypes &&
+		typclass->typtype == 'b' &&
+		att->atttypid < FirstNormalObjectId &&
+		typclass->typelem == InvalidOid)
+	{
+		return 'b';
+	}
+
+	return 't';
+}
@@ -77,20 +77,11 @@ resolver_at_exit(int status, Datum arg)
  *
  *****************************************************************************/
 
-/* gid_t is system type... */
-typedef char pgid_t[GIDSIZE];
-
 static void
 ResolveForRefereeWinner(void)
 {
 	MtmGeneration curr_gen;
-	HASH_SEQ_STATUS hash_seq;
 	GlobalTx   *gtx;
-	/*
-	 * Calling FinishPreparedTransaction under lwlock is probably not a good
-	 * idea (as well as waiting inside GlobalTxAcquire), so let's collect
-	 * xacts here and finish them after release.
-	 */
 	pgid_t *gids;
 	int n_gids = 0;
 	int i;
@@ -115,21 +106,8 @@ ResolveForRefereeWinner(void)
 	}
 
 	mtm_log(ResolverState, "resolving as referee winner");
-	gids = palloc(sizeof(pgid_t) * max_prepared_xacts);
-
-	LWLockAcquire(gtx_shared->lock, LW_SHARED);
-	hash_seq_init(&hash_seq, gtx_shared->gid2gtx);
-	while ((gtx = hash_seq_search(&hash_seq)) != NULL)
-	{
-		/* skip not orphaned xacts, will pick them up next time */
-		if (!gtx->orphaned)
-			continue;
-
-		Assert(n_gids < max_prepared_xacts);
-		strcpy(gids[n_gids], gtx->gid);
-		n_gids++;
-	}
-	LWLockRelease(gtx_shared->lock);
+	/* not orphaned xacts are not listed, will pick them up next time */
+	n_gids = GlobalTxListOrphaned(&gids);
 
 	for (i = 0; i < n_gids; i++)
 	{
@@ -163,7 +141,7 @@ ResolveForRefereeWinner(void)
 }
 
 /*
- * Called periodically. Iterate over gtxes and
+ * Called periodically. Iterate over orphaned gtxes and
  * - finish xact immediately if we can (it is our xact which never got
  *   precommitted with backend gone dead)
  * - determine whether we still need to actually resolve something,
@@ -173,21 +151,27 @@ static bool
 finish_ready(void)
 {
 	bool job_pending = false;
-	HASH_SEQ_STATUS hash_seq;
 	GlobalTx   *gtx;
+	pgid_t *gids;
+	int n_gids;
 	/*
 	 * Calling FinishPreparedTransaction under lwlock is probably not a good
 	 * idea ((as well as waiting inside GlobalTxAcquire), so let's collect
 	 * xacts here and finish them after release.
 	 */
-	pgid_t *agids = palloc(sizeof(pgid_t) * max_prepared_xacts);
+	pgid_t *agids;
 	int n_agids = 0;
 	int i;
 
-	LWLockAcquire(gtx_shared->lock, LW_SHARED);
-	hash_seq_init(&hash_seq, gtx_shared->gid2gtx);
-	while ((gtx = hash_seq_search(&hash_seq)) != NULL)
+	n_gids = GlobalTxListOrphaned(&gids);
+	agids = palloc(sizeof(pgid_t) * Max(n_gids, 1));
+
+	for (i = 0; i < n_gids; i++)
 	{
+		gtx = GlobalTxLockByGid(gids[i], LW_SHARED);
+		if (!gtx)
+			continue;
+
 		/*
 		 * don't intervene if backend is still working on xact or it is not
 		 * prepared yet
@@ -195,6 +179,7 @@ finish_ready(void)
 		if (gtx->acquired_by != InvalidBackendId ||
 			!gtx->orphaned || !gtx->prepared)
 		{
+			GlobalTxUnlock(gtx);
 			continue;
 		}
 
@@ -213,16 +198,17 @@ finish_ready(void)
 			gtx->state.status == GTXInvalid &&
 			!IS_EXPLICIT_2PC_GID(gtx->gid))
 		{
-			Assert(n_agids < max_prepared_xacts);
 			strcpy(agids[n_agids], gtx->gid);
 			n_agids++;
+			GlobalTxUnlock(gtx);
 			continue;
 		}
 
 		/* so we have orphaned xact needing resolution */
 		job_pending = true;
+		GlobalTxUnlock(gtx);
 	}
-	LWLockRelease(gtx_shared->lock);
+	pfree(gids);
 
 	/* finish ready xacts */
 	for (i = 0; i < n_agids; i++)
@@ -277,9 +263,11 @@ scatter(MtmConfig *mtm_cfg, nodemask_t cmask, char *stream_name, StringInfo msg)
 static void
 scatter_status_requests(MtmConfig *mtm_cfg)
 {
-	HASH_SEQ_STATUS hash_seq;
 	GlobalTx   *gtx;
 	GlobalTxTerm new_term;
+	pgid_t	   *gids;
+	int			n_gids;
+	int			i;
 
 	/*
 	 * It is almost pointless to resolve unless we see the majority, do not
@@ -313,10 +301,13 @@ scatter_status_requests(MtmConfig *mtm_cfg)
 	 * Stamp all orphaned transactions with the new proposal and send status
 	 * requests.
 	 */
-	LWLockAcquire(gtx_shared->lock, LW_EXCLUSIVE);
-	hash_seq_init(&hash_seq, gtx_shared->gid2gtx);
-	while ((gtx = hash_seq_search(&hash_seq)) != NULL)
+	n_gids = GlobalTxListOrphaned(&gids);
+	for (i = 0; i < n_gids; i++)
 	{
+		gtx = GlobalTxLockByGid(gids[i], LW_EXCLUSIVE);
+		if (!gtx)
+			continue;
+
 		/* skip acquired until next round */
 		if (gtx->orphaned && gtx->acquired_by == InvalidBackendId &&
 			/*
@@ -358,6 +349,7 @@ scatter_status_requests(MtmConfig *mtm_cfg)
 					serialize_xstate(&gtx->xinfo, &new_gtx_state),
 					false);
 				gtx->state.proposal = new_term;
+				GlobalTxNoteProposal(new_term);
 				mtm_log(MtmTxTrace, "proposal term (%d, %d) stamped to transaction %s",
 						new_term.ballot, new_term.node_id, gtx->gid);
 			}
@@ -372,8 +364,9 @@ scatter_status_requests(MtmConfig *mtm_cfg)
 			scatter(mtm_cfg, connected, "reqresp",
 					MtmMessagePack((MtmMessage *) &status_msg));
 		}
+		GlobalTxUnlock(gtx);
 	}
-	LWLockRelease(gtx_shared->lock);
+	pfree(gids);
 }
 
 static void
@@ -439,6 +432,22 @@ quorum(MtmConfig *mtm_cfg, GTxState *all_states)
 	return MtmQuorum(mtm_cfg, n_states);
 }
 
+/*
+ * Coordinator of xact with skip_precommit commits it without asking anyone,
+ * so we can't decide unless it is among the voters of our term: its vote
+ * (given only after it has released the xact) means it hasn't committed and
+ * won't.
+ */
+static bool
+coordinator_voted(GlobalTx *gtx)
+{
+	if (!gtx->xinfo.skip_precommit)
+		return true;
+
+	return term_cmp(gtx->phase1_acks[gtx->xinfo.coordinator - 1].proposal,
+					gtx->state.proposal) == 0;
+}
+
 static void
 handle_response(MtmConfig *mtm_cfg, MtmMessage *raw_msg)
 {
@@ -487,7 +496,8 @@ handle_response(MtmConfig *mtm_cfg, MtmMessage *raw_msg)
 			return;
 		}
 		else if (quorum(mtm_cfg, gtx->phase1_acks) &&
-				 !IS_EXPLICIT_2PC_GID(gtx->gid))
+				 !IS_EXPLICIT_2PC_GID(gtx->gid) &&
+				 coordinator_voted(gtx))
 		{
 			int			i;
 			char	   *xstate;
@@ -690,6 +700,8 @@ ResolverMain(Datum main_arg)
 		{
 			bool job_pending;
 
+			/* pick up xacts coordinators failed to hand over to us */
+			GlobalTxMigrateStuck();
 			if (IS_REFEREE_ENABLED())
 				ResolveForRefereeWinner();
 			job_pending = finish_ready();
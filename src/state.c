@@ -87,6 +87,18 @@ static char const *const MtmStatusInGenMnem[] =
 	"online"
 };
 
+/* prepare barrier counters of backends with pgprocno % PB_NUM_SHARDS == i */
+#define PB_NUM_SHARDS 32
+typedef union PBShard
+{
+	struct
+	{
+		pg_atomic_uint32 n_apply_preparers;
+		pg_atomic_uint32 n_backend_preparers;
+	}			c;
+	char		pad[PG_CACHE_LINE_SIZE];
+} PBShard;
+
 struct MtmState
 {
 	/*
@@ -128,14 +140,22 @@ struct MtmState
 	LWLock	   *gen_lock;
 	/*
 	 * However, gen switcher must also take this barrier as keeping LWLock
-	 * during PREPARE is not nice.
+	 * during PREPARE is not nice. Preparers come on every commit while
+	 * holders are rare, so preparers only bump counter of their shard and
+	 * check holder counts, and holders sum up the shards.
 	 */
-	slock_t cb_lock;
-	int			n_apply_preparers;
-	int			n_backend_preparers;
-	int			n_backend_holders;
-	int			n_full_holders;
+	pg_atomic_uint32 n_backend_holders;
+	pg_atomic_uint32 n_full_holders;
+	PBShard		pb_shards[PB_NUM_SHARDS];
 	ConditionVariable commit_barrier_cv;
+
+	/*
+	 * MtmGetCurrentStatus result is cached here along with status_version
+	 * it was computed at (version << 8 | status); everyone changing inputs
+	 * of the status bumps status_version, see MtmStatusChanged.
+	 */
+	pg_atomic_uint64 status_version;
+	pg_atomic_uint64 published_status;
 	/*
 	 * Voters exclude each other and gen switch, but don't change current gen
 	 * and thus allow (e.g. heartbeat sender) to peek it, hence the second
@@ -229,6 +249,7 @@ PG_FUNCTION_INFO_V1(mtm_state_create);
 PG_FUNCTION_INFO_V1(mtm_get_logged_prepared_xact_state);
 
 static bool pb_hook_registred = false;
+static PBShard *pb_shard;
 
 /* Variation of acquired prepare barrier. */
 typedef enum
@@ -241,6 +262,16 @@ typedef enum
 } PrepareBarrierMode;
 static PrepareBarrierMode pb_acquired_in_mode;
 
+/*
+ * Invalidate published status; must be called after changing anything
+ * MtmGetCurrentStatus looks at.
+ */
+static inline void
+MtmStatusChanged(void)
+{
+	pg_atomic_fetch_add_u64(&mtm_state->status_version, 1);
+}
+
 static bool	campaign_requested;
 
 /*
@@ -280,7 +311,15 @@ MtmStateShmemStartup()
 			pg_atomic_init_u64(&mtm_state->others_last_online_in[i], MtmInvalidGenNum);
 		}
 
-		SpinLockInit(&mtm_state->cb_lock);
+		pg_atomic_init_u64(&mtm_state->status_version, 1);
+		pg_atomic_init_u64(&mtm_state->published_status, 0);
+		pg_atomic_init_u32(&mtm_state->n_backend_holders, 0);
+		pg_atomic_init_u32(&mtm_state->n_full_holders, 0);
+		for (i = 0; i < PB_NUM_SHARDS; i++)
+		{
+			pg_atomic_init_u32(&mtm_state->pb_shards[i].c.n_apply_preparers, 0);
+			pg_atomic_init_u32(&mtm_state->pb_shards[i].c.n_backend_preparers, 0);
+		}
 		ConditionVariableInit(&mtm_state->commit_barrier_cv);
 
 		pg_atomic_init_u32(&mtm_state->receive_mode, RECEIVE_MODE_DISABLED);
@@ -321,6 +360,7 @@ MtmStateStartup(void)
 			pg_atomic_write_u32(&mtm_state->receive_mode, RECEIVE_MODE_DISABLED);
 			break;
 	}
+	MtmStatusChanged();
 
 	/*
 	 * if we crashed after file update to online but before logging PS,
@@ -387,6 +427,7 @@ mtm_state_create(PG_FUNCTION_ARGS)
 	 * MtmStateStartup, re-reading it from disk
 	 */
 	pg_atomic_write_u64(&mtm_state->current_gen_num, MtmInvalidNodeId);
+	MtmStatusChanged();
 	LWLockRelease(mtm_state->gen_lock);
 	PG_RETURN_VOID();
 }
@@ -519,6 +560,7 @@ MtmConsiderGenSwitch(MtmGeneration gen, nodemask_t donors)
 	mtm_state->current_gen_members = gen.members;
 	mtm_state->current_gen_configured = gen.configured;
 	mtm_state->donors = donors;
+	MtmStatusChanged();
 
 	/*
 	 * xxx SetLatch of all backends here? Waiting for acks after gen switch
@@ -573,6 +615,7 @@ MtmConsiderGenSwitch(MtmGeneration gen, nodemask_t donors)
 		mtm_state->ps_logged = false;
 		mtm_state->last_online_in = gen.num;
 		MtmStateSave(); /* fsync state update */
+		MtmStatusChanged();
 
 		/*
 		 * Write to WAL ParallelSafe<gen_num> message, which is a mark for
@@ -697,6 +740,7 @@ MtmHandleParallelSafe(MtmGeneration ps_gen, nodemask_t ps_donors,
 	mtm_state->ps_logged = false;
 	mtm_state->last_online_in = ps_gen.num;
 	MtmStateSave();
+	MtmStatusChanged();
 	LogParallelSafe(ps_gen, ps_donors);
 	mtm_state->ps_logged = true;
 	MtmStateSave();
@@ -786,12 +830,30 @@ MtmGetCurrentStatusInGenNotLocked(void)
  *
  * Additionally distinguishes between 'need recovery, but have no idea from
  * whom' and 'recovering from some node'.
+ *
+ * This is called on each xact start, so unless caller holds the locks
+ * anyway, return the published result if nothing has changed since it was
+ * computed; otherwise compute and publish it.
  */
 MtmNodeStatus
 MtmGetCurrentStatus(bool gen_locked, bool vote_locked)
 {
 	MtmStatusInGen status_in_gen;
 	MtmNodeStatus res;
+	uint64		version = 0;
+	bool		cacheable = !gen_locked && !vote_locked;
+
+	if (cacheable)
+	{
+		uint64		published;
+
+		version = pg_atomic_read_u64(&mtm_state->status_version);
+		published = pg_atomic_read_u64(&mtm_state->published_status);
+		if ((published >> 8) == version)
+			return (MtmNodeStatus) (published & 0xFF);
+		/* read the inputs only after the version */
+		pg_memory_barrier();
+	}
 
 	/* doesn't impress with elegance, really */
 	if (!gen_locked)
@@ -868,6 +930,14 @@ MtmGetCurrentStatus(bool gen_locked, bool vote_locked)
 		LWLockRelease(mtm_state->vote_lock);
 	if (!gen_locked)
 		LWLockRelease(mtm_state->gen_lock);
+
+	/*
+	 * Concurrent computation with older version might overwrite ours;
+	 * that's harmless as the next caller will just recompute.
+	 */
+	if (cacheable)
+		pg_atomic_write_u64(&mtm_state->published_status,
+							(version << 8) | (uint64) res);
 	return res;
 }
 
@@ -1323,6 +1393,7 @@ CampaignMyself(MtmConfig *mtm_cfg, MtmGeneration *candidate_gen,
 		mtm_state->last_vote = *candidate_gen;
 		MtmStateSave();
 	}
+	MtmStatusChanged(); /* campaigner_on_tour and probably last_vote */
 
 	mtm_log(MtmStateSwitch, "proposed and voted myself for gen num=" UINT64_FORMAT ", members=%s, configured=%s, clique=%s",
 			candidate_gen->num,
@@ -1490,6 +1561,7 @@ CampaignTour(MtmConfig *mtm_cfg,
 		}
 	}
 	mtm_state->campaigner_on_tour = false;
+	MtmStatusChanged();
 	LWLockRelease(mtm_state->vote_lock);
 	LWLockRelease(mtm_state->gen_lock);
 }
@@ -1515,6 +1587,7 @@ CampaignReferee(MtmGeneration candidate_gen)
 				PQerrorMessage(conn));
 		PQfinish(conn);
 		mtm_state->campaigner_on_tour = false;
+		MtmStatusChanged();
 		return;
 	}
 
@@ -1528,6 +1601,7 @@ CampaignReferee(MtmGeneration candidate_gen)
 		PQclear(res);
 		PQfinish(conn);
 		mtm_state->campaigner_on_tour = false;
+		MtmStatusChanged();
 		/*
 		 * Though the query errored out, we could already managed to acquire
 		 * the grant (imagine network failure after commit). And if second
@@ -1553,6 +1627,7 @@ CampaignReferee(MtmGeneration candidate_gen)
 		PQclear(res);
 		PQfinish(conn);
 		mtm_state->campaigner_on_tour = false;
+		MtmStatusChanged();
 		return;
 	}
 
@@ -1566,6 +1641,7 @@ CampaignReferee(MtmGeneration candidate_gen)
 	BIT_SET(donors, Mtm->my_node_id - 1);
 	MtmConsiderGenSwitch(candidate_gen, donors);
 	mtm_state->campaigner_on_tour = false;
+	MtmStatusChanged();
 }
 
 /*
@@ -1939,6 +2015,7 @@ HandleGenVoteRequest(MtmConfig *mtm_cfg, MtmGenVoteRequest *req,
 	old_status_in_gen = MtmGetCurrentStatusInGen();
 	mtm_state->last_vote = req->gen;
 	MtmStateSave();
+	MtmStatusChanged();
 
 	/*
 	 * If we are not online in current generation, probably after
@@ -1981,6 +2058,7 @@ static void
 MtmSetReceiveMode(uint32 mode)
 {
 	pg_atomic_write_u32(&mtm_state->receive_mode, mode);
+	MtmStatusChanged();
 	/* waking up receivers while disabled is not dangerous but pointless */
 	if (mode != RECEIVE_MODE_DISABLED)
 		MtmWakeupReceivers();
@@ -2112,6 +2190,7 @@ MtmOnDmqReceiverConnect(char *node_name)
 	if (BIT_CHECK(mtm_state->dmq_receivers_mask, node_id - 1))
 		mtm_log(ERROR, "dmq receiver from node %d already connected", node_id);
 	BIT_SET(mtm_state->dmq_receivers_mask, node_id - 1);
+	MtmStatusChanged();
 	LWLockRelease(mtm_state->connectivity_lock);
 
 	CampaignerWake();
@@ -2155,6 +2234,8 @@ MtmOnDmqReceiverHeartbeat(char *node_name, StringInfo msg, void *extra)
 	if (mtm_state->connectivity_matrix[node_id - 1] != parsed_msg->connected_mask)
 		changed = true; /* neighbour's connectivity mask changed */
 	mtm_state->connectivity_matrix[node_id - 1] = parsed_msg->connected_mask;
+	if (changed)
+		MtmStatusChanged();
 
 	LWLockRelease(mtm_state->connectivity_lock);
 
@@ -2185,6 +2266,7 @@ MtmOnDmqReceiverDisconnect(char *node_name)
 	if (old_connected_mask != MtmGetConnectedMask(true))
 		changed = true;
 	mtm_state->connectivity_matrix[node_id - 1] = 0;
+	MtmStatusChanged();
 
 	LWLockRelease(mtm_state->connectivity_lock);
 	if (changed)
@@ -2224,6 +2306,7 @@ MtmOnDmqSenderConnect(char *node_name)
 	BIT_SET(mtm_state->dmq_senders_mask, node_id - 1);
 	if (old_connected_mask != MtmGetConnectedMask(true))
 		changed = true;
+	MtmStatusChanged();
 	LWLockRelease(mtm_state->connectivity_lock);
 
 	if (changed)
@@ -2272,6 +2355,7 @@ MtmOnDmqSenderDisconnect(char *node_name)
 	BIT_CLEAR(mtm_state->dmq_senders_mask, node_id - 1);
 	if (old_connected_mask != MtmGetConnectedMask(true))
 		changed = true;
+	MtmStatusChanged();
 	LWLockRelease(mtm_state->connectivity_lock);
 
 	if (changed)
@@ -2567,41 +2651,64 @@ PBOnExit(int code, Datum arg)
 	ReleasePB();
 }
 
+/*
+ * Preparer increments its counter and then checks holders, holder increments
+ * its counter and then sums up preparers; atomic increments are full
+ * barriers, so at least one of them sees the other.
+ */
+static bool
+pb_holders_present(bool backend)
+{
+	return pg_atomic_read_u32(&mtm_state->n_full_holders) != 0 ||
+		(backend && pg_atomic_read_u32(&mtm_state->n_backend_holders) != 0);
+}
+
+static bool
+pb_preparers_present(bool full)
+{
+	int			i;
+
+	for (i = 0; i < PB_NUM_SHARDS; i++)
+	{
+		if (pg_atomic_read_u32(&mtm_state->pb_shards[i].c.n_backend_preparers) != 0 ||
+			(full && pg_atomic_read_u32(&mtm_state->pb_shards[i].c.n_apply_preparers) != 0))
+			return true;
+	}
+	return false;
+}
+
 /* Exclude all (or full only, if backend=false) holders */
 void
 AcquirePBByPreparer(bool backend)
 {
+	pg_atomic_uint32 *counter;
+
 	Assert(!pb_acquired_in_mode);
 	if (!pb_hook_registred)
 	{
 		before_shmem_exit(PBOnExit, (Datum) 0);
 		pb_hook_registred = true;
 	}
+	pb_shard = &mtm_state->pb_shards[MyProc->pgprocno % PB_NUM_SHARDS];
+	counter = backend ? &pb_shard->c.n_backend_preparers :
+		&pb_shard->c.n_apply_preparers;
 	for (;;)
 	{
-		SpinLockAcquire(&mtm_state->cb_lock);
-		if (backend)
-		{
-			if (mtm_state->n_backend_holders == 0 &&
-				mtm_state->n_full_holders == 0)
-			{
-				mtm_state->n_backend_preparers += 1;
-				pb_acquired_in_mode = PB_BACKEND_PREPARER;
-			}
-		}
-		else
+		pg_atomic_fetch_add_u32(counter, 1);
+		if (!pb_holders_present(backend))
 		{
-			if (mtm_state->n_full_holders == 0)
-			{
-				mtm_state->n_apply_preparers += 1;
-				pb_acquired_in_mode = PB_APPLY_PREPARER;
-			}
-		}
-		SpinLockRelease(&mtm_state->cb_lock);
-
-		if (pb_acquired_in_mode)
+			pb_acquired_in_mode = backend ? PB_BACKEND_PREPARER :
+				PB_APPLY_PREPARER;
 			break;
+		}
 
+		/*
+		 * Back off and let the holder in. It waits for all shards to drain,
+		 * so it is worth waking (along with everyone else sleeping here)
+		 * only if we were the last in ours.
+		 */
+		if (pg_atomic_fetch_sub_u32(counter, 1) == 1)
+			ConditionVariableBroadcast(&mtm_state->commit_barrier_cv);
 		ConditionVariableSleep(&mtm_state->commit_barrier_cv, PG_WAIT_EXTENSION);
 	}
 	ConditionVariableCancelSleep();
@@ -2622,32 +2729,20 @@ AcquirePBByHolder(bool full)
 		pb_hook_registred = true;
 	}
 	/* Holder has the priority, so prevent new preparers immediately */
-	SpinLockAcquire(&mtm_state->cb_lock);
 	if (full)
 	{
-		mtm_state->n_full_holders += 1;
+		pg_atomic_fetch_add_u32(&mtm_state->n_full_holders, 1);
 		pb_acquired_in_mode = PB_FULL_HOLDER;
 	}
 	else
 	{
-		mtm_state->n_backend_holders += 1;
+		pg_atomic_fetch_add_u32(&mtm_state->n_backend_holders, 1);
 		pb_acquired_in_mode = PB_BACKEND_HOLDER;
 	}
-	SpinLockRelease(&mtm_state->cb_lock);
 
 	for (;;)
 	{
-		bool done = false;
-
-		SpinLockAcquire(&mtm_state->cb_lock);
-		if (mtm_state->n_backend_preparers == 0 &&
-			(!full || mtm_state->n_apply_preparers == 0))
-		{
-			done = true;
-		}
-		SpinLockRelease(&mtm_state->cb_lock);
-
-		if (done)
+		if (!pb_preparers_present(full))
 			break;
 
 		PG_TRY();
@@ -2664,25 +2759,35 @@ AcquirePBByHolder(bool full)
 	ConditionVariableCancelSleep();
 }
 
-/* Release prepare barrier. No-op, if not acquired. */
+/*
+ * Release prepare barrier. No-op, if not acquired. Preparer needs to wake
+ * up only holders, so it doesn't touch the condvar if there are none.
+ */
 void
 ReleasePB(void)
 {
+	bool		wakeup = true;
+
 	if (!pb_acquired_in_mode)
 		return;
-	SpinLockAcquire(&mtm_state->cb_lock);
 	if (pb_acquired_in_mode == PB_APPLY_PREPARER)
-		mtm_state->n_apply_preparers -= 1;
+	{
+		pg_atomic_fetch_sub_u32(&pb_shard->c.n_apply_preparers, 1);
+		wakeup = pb_holders_present(false);
+	}
 	else if (pb_acquired_in_mode == PB_BACKEND_PREPARER)
-		mtm_state->n_backend_preparers -= 1;
+	{
+		pg_atomic_fetch_sub_u32(&pb_shard->c.n_backend_preparers, 1);
+		wakeup = pb_holders_present(true);
+	}
 	else if (pb_acquired_in_mode == PB_BACKEND_HOLDER)
-		mtm_state->n_backend_holders -= 1;
+		pg_atomic_fetch_sub_u32(&mtm_state->n_backend_holders, 1);
 	else if (pb_acquired_in_mode == PB_FULL_HOLDER)
-		mtm_state->n_full_holders -= 1;
+		pg_atomic_fetch_sub_u32(&mtm_state->n_full_holders, 1);
 	else
 		Assert(false);
-	SpinLockRelease(&mtm_state->cb_lock);
-	ConditionVariableBroadcast(&mtm_state->commit_barrier_cv);
+	if (wakeup)
+		ConditionVariableBroadcast(&mtm_state->commit_barrier_cv);
 	pb_acquired_in_mode = PB_NONE;
 }
 
@@ -2932,6 +3037,7 @@ MtmStateLoad(void)
 	mtm_state->last_online_in = ondisk.last_online_in;
 	mtm_state->last_vote = ondisk.last_vote;
 	mtm_state->ps_logged = ondisk.ps_logged;
+	MtmStatusChanged();
 
 	mtm_log(MtmStateMessage, "loaded state: current_gen_num=" UINT64_FORMAT ", current_gen_members=%s, current_gen_configured=%s, donors=%s, last_online_in=" UINT64_FORMAT ", last_vote.num=" UINT64_FORMAT ", last_vote.members=%s",
 			pg_atomic_read_u64(&mtm_state->current_gen_num),
@@ -2979,6 +3085,7 @@ handle_1a_gtx(MtmTxRequest *msg, GlobalTx *gtx, MtmTxStatusResponse *resp)
 		if (!done)
 			Assert(false);
 		gtx->state.proposal = msg->term;
+		GlobalTxNoteProposal(msg->term);
 		mtm_log(MtmTxTrace, "TXTRACE: processed 1a, set state %s", GlobalTxToString(gtx));
 
 		resp->state = (GTxState) {
@@ -3041,7 +3148,18 @@ static void handle_1a(txset_entry *txse, HTAB *txset, bool *wal_scanned,
 	}
 
 	/*
-	 * We don't have PREPARED xact; time to dig in WAL, probably we've already
+	 * We don't have PREPARED xact; most likely we've just finished it, and
+	 * then outcome index knows the result.
+	 */
+	if (GlobalTxLookupOutcome(msg->gid, &resp->state.status))
+	{
+		mtm_log(StatusRequest, "outcome of %s is %s according to outcome index",
+				msg->gid, GlobalTxStatusMnem[resp->state.status]);
+		goto reply_1a;
+	}
+
+	/*
+	 * Otherwise it is time to dig in WAL, probably we've already
 	 * committed|aborted it. But before doing this remember last_online_in to
 	 * reply with direct ABORT for transactions which can't ever be committed
 	 * -- this prevents recovery deadlocks as explained below
@@ -3189,6 +3307,14 @@ handle_2a(MtmTxRequest *msg, int dest_id, int dest_node_id)
 		msg->gid
 	};
 	bool		gtx_busy;
+	/*
+	 * Coordinator's own precommit sent directly (see MtmSendDirectPrecommit)
+	 * rather than resolver's ballot. Its answer goes straight to the backend
+	 * waiting for it, and only if we accepted the decree: otherwise the
+	 * apply worker will answer once it decodes the same 2a from WAL.
+	 */
+	bool		direct = msg->type == MTReq_Precommit &&
+		term_cmp(msg->term, InitialGTxTerm) == 0;
 
 	/*
 	 * Explicit 2PC never does paxos resolving with 2a, so MtmGidParseNodeId
@@ -3205,6 +3331,8 @@ handle_2a(MtmTxRequest *msg, int dest_id, int dest_node_id)
 			mtm_log(StatusRequest, "ignoring 2A message for xact %s as backend is still working on it",
 					msg->gid);
 
+		if (direct)
+			return;
 		goto reply_2a;
 	}
 
@@ -3224,18 +3352,25 @@ handle_2a(MtmTxRequest *msg, int dest_id, int dest_node_id)
 			GTXPreCommitted : GTXPreAborted;
 
 		new_gtx_state = (GTxState) {msg->term, msg->term, new_status};
-		StartTransactionCommand();
-		xstate = serialize_xstate(&gtx->xinfo, &new_gtx_state);
-		done = SetPreparedTransactionState(gtx->gid, xstate, false);
-		if (!done)
-			Assert(false);
-		CommitTransactionCommand();
-		/* transaction knocked down old ctx*/
-		MemoryContextSwitchTo(oldcontext);
+		/* direct and WAL precommits deliver the same decree, write it once */
+		if (gtx->state.status != new_status ||
+			term_cmp(gtx->state.accepted, msg->term) != 0 ||
+			term_cmp(gtx->state.proposal, msg->term) != 0)
+		{
+			StartTransactionCommand();
+			xstate = serialize_xstate(&gtx->xinfo, &new_gtx_state);
+			done = SetPreparedTransactionState(gtx->gid, xstate, false);
+			if (!done)
+				Assert(false);
+			CommitTransactionCommand();
+			/* transaction knocked down old ctx*/
+			MemoryContextSwitchTo(oldcontext);
+		}
 
 		gtx->state.proposal = msg->term;
 		gtx->state.accepted = msg->term;
 		gtx->state.status = new_status;
+		GlobalTxNoteProposal(msg->term);
 		mtm_log(MtmTxTrace, "TXTRACE: processed 2a, set state %s", GlobalTxToString(gtx));
 
 		resp.status = gtx->state.status;
@@ -3243,6 +3378,19 @@ handle_2a(MtmTxRequest *msg, int dest_id, int dest_node_id)
 	}
 	GlobalTxRelease(gtx);
 
+	if (direct)
+	{
+		if (resp.status != GTXPreCommitted)
+			return;
+
+		mtm_log(StatusRequest, "replying to direct precommit of %s from node %d",
+				msg->gid, dest_node_id);
+		packed_msg = MtmMessagePack((MtmMessage *) &resp);
+		dmq_push_buffer(dest_id, psprintf("xid" XID_FMT, MtmGidParseXid(msg->gid)),
+						packed_msg->data, packed_msg->len);
+		return;
+	}
+
 reply_2a:
 	mtm_log(StatusRequest, "replying to 2a from node %d with %s",
 			dest_node_id,
@@ -4022,6 +4170,7 @@ MtmMonitor(Datum arg)
 		LWLockAcquire(mtm_state->gen_lock, LW_EXCLUSIVE);
 		mtm_state->last_online_in = MtmInvalidGenNum;
 		MtmStateSave();
+		MtmStatusChanged();
 		LWLockRelease(mtm_state->gen_lock);
 
 		StartTransactionCommand();
@@ -0,0 +1,64 @@
+# UPDATEs of REPLICA IDENTITY FULL tables are streamed as column deltas:
+# check that receivers reconstruct exactly the same rows.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Test::More tests => 3;
+
+my $cluster = new Cluster(3);
+$cluster->init();
+$cluster->start();
+$cluster->create_mm();
+
+my $cols = join(', ', map { "c$_ int" } (1..60));
+$cluster->safe_psql(0, qq{
+	create table wide_pk (id int primary key, $cols, t text);
+	alter table wide_pk replica identity full;
+	insert into wide_pk select g, } . join(', ', map { "g + $_" } (1..60)) . qq{, repeat('x', g)
+		from generate_series(1, 100) g;
+
+	create table wide_nopk (id int, $cols, t text);
+	alter table wide_nopk replica identity full;
+	insert into wide_nopk select g, } . join(', ', map { "g + $_" } (1..60)) . qq{, repeat('x', g)
+		from generate_series(1, 100) g;
+});
+
+# narrow updates, null transitions, key change and toasted value
+foreach my $t ('wide_pk', 'wide_nopk')
+{
+	$cluster->safe_psql(0, qq{
+		update $t set c7 = c7 + 1 where id % 2 = 0;
+		update $t set c30 = null where id % 3 = 0;
+		update $t set c30 = 42 where id % 9 = 0;
+		update $t set t = repeat('y', 10000) where id = 5;
+		update $t set c1 = c1 + 1 where id = 5;
+		update $t set id = id + 1000 where id = 7;
+	});
+	$cluster->safe_psql(1, qq{update $t set c60 = -c60 where id < 50;});
+}
+
+my $hash_query = q{
+	select md5(string_agg(x::text, ',')) from
+	(select * from wide_pk order by id) x
+	union all
+	select md5(string_agg(x::text, ',')) from
+	(select * from wide_nopk order by id, c1) x;
+};
+
+# make sure everything is applied everywhere
+$cluster->safe_psql($_, "select mtm.ping()") foreach (0..2);
+
+my $hash0 = $cluster->safe_psql(0, $hash_query);
+my $hash1 = $cluster->safe_psql(1, $hash_query);
+my $hash2 = $cluster->safe_psql(2, $hash_query);
+note("$hash0, $hash1, $hash2");
+is($hash0, $hash1, "node1 and node2 have the same rows after delta updates");
+is($hash1, $hash2, "node2 and node3 have the same rows after delta updates");
+
+is($cluster->safe_psql(2, "select c7, c30, length(t) from wide_pk where id = 1000 + 7"),
+	"14|37|7", "row with changed key is in place");
+
+$cluster->stop();
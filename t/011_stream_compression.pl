@@ -0,0 +1,83 @@
+# Bulk load with replication stream compression off and on: check that data
+# arrives intact and report bytes on the wire and apply time for both.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Test::More tests => 4;
+use Time::HiRes qw(time);
+
+my $cluster = new Cluster(3);
+$cluster->init();
+$cluster->start();
+$cluster->create_mm();
+
+my $rows = 200000;
+
+sub bulk_load
+{
+	my ($table) = @_;
+
+	my $start = time();
+	$cluster->safe_psql(0, qq{
+		create table $table (id int primary key, payload text, n numeric);
+		insert into $table select g, 'row number ' || g || repeat(' filler', 10), g * 1.5
+			from generate_series(1, $rows) g;
+	});
+	foreach my $i (1..2)
+	{
+		$cluster->{nodes}->[$i]->poll_query_until('postgres',
+			"select count(*) = $rows from $table")
+		  or die "timed out waiting for $table on node$i";
+	}
+	return time() - $start;
+}
+
+sub table_hashes
+{
+	my ($table) = @_;
+	return map { $cluster->safe_psql($_,
+		"select md5(string_agg(x::text, ',')) from (select * from $table order by id) x") } (0..2);
+}
+
+my $plain_time = bulk_load('bulk_plain');
+my @hashes = table_hashes('bulk_plain');
+ok($hashes[0] eq $hashes[1] && $hashes[1] eq $hashes[2],
+   "uncompressed stream delivered the same data");
+
+# receivers ask for compression on reconnect
+foreach my $node (@{$cluster->{nodes}})
+{
+	$node->append_conf('postgresql.conf', q{multimaster.stream_compression = pglz});
+	$node->restart;
+}
+$cluster->await_nodes([0,1,2]);
+
+my $compressed_time = bulk_load('bulk_pglz');
+@hashes = table_hashes('bulk_pglz');
+ok($hashes[0] eq $hashes[1] && $hashes[1] eq $hashes[2],
+   "compressed stream delivered the same data");
+
+# writes in both directions still work
+$cluster->safe_psql(1, "update bulk_pglz set n = -n where id % 1000 = 0");
+$cluster->safe_psql($_, "select mtm.ping()") foreach (0..2);
+is($cluster->safe_psql(2, "select count(*) from bulk_pglz where n < 0"),
+   $rows / 1000, "updates from another node are applied");
+
+$cluster->stop();
+
+# walsenders of node1 report what they have sent
+my ($raw, $sent) = (0, 0);
+foreach my $line (split /\n/, slurp_file($cluster->{nodes}->[0]->logfile))
+{
+	if ($line =~ /stream compression: (\d+) bytes sent as (\d+)/)
+	{
+		$raw += $1;
+		$sent += $2;
+	}
+}
+note(sprintf("apply time: %.2fs uncompressed, %.2fs pglz", $plain_time, $compressed_time));
+note("bytes on the wire from node1: $raw raw, $sent compressed");
+ok($sent > 0 && $sent < $raw, "stream was compressed");
@@ -0,0 +1,91 @@
+# Two sessions finishing the same explicitly prepared transaction at once:
+# exactly one of them must succeed, and the loser, which has to wait until
+# the winner releases the global transaction, should learn the outcome
+# without sleeping-and-retrying delays. Reports how long the loser waited.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Time::HiRes qw(time usleep);
+
+# Test whether we have both DBI and DBD::pg
+my $dbdpg_rc = eval
+{
+  require DBI;
+  require DBD::Pg;
+  DBD::Pg->import(':async');
+  1;
+};
+
+require Test::More;
+if (not $dbdpg_rc)
+{
+	Test::More->import(skip_all => 'DBI and DBD::Pg are not available');
+}
+else
+{
+	Test::More->import(tests => 2);
+}
+
+my $cluster = new Cluster(3);
+$cluster->init();
+$cluster->start();
+$cluster->create_mm();
+
+$cluster->safe_psql(0, "create table gtx_race(id int primary key)");
+
+my $rounds = 50;
+my @conns = map {
+	DBI->connect('DBI:Pg:' . $cluster->connstr(0), undef, undef,
+				 { PrintError => 0, RaiseError => 0 })
+} 0..1;
+
+# Since we are not importing DBD::Pg at compilation time, we can't use
+# constants from it.
+my $DBD_PG_PG_ASYNC = 1;
+
+my $bad_rounds = 0;
+my @latencies;
+foreach my $i (1..$rounds)
+{
+	$cluster->safe_psql(0, qq{
+		begin;
+		insert into gtx_race values ($i);
+		prepare transaction 'gtx_race_$i';
+	});
+
+	my $start = time();
+	$_->do("commit prepared 'gtx_race_$i'", { pg_async => $DBD_PG_PG_ASYNC })
+	  foreach @conns;
+
+	my @done = (0, 0);
+	my $succeeded = 0;
+	while (!$done[0] || !$done[1])
+	{
+		foreach my $c (0..1)
+		{
+			next if $done[$c] || !$conns[$c]->pg_ready();
+			$succeeded++ if defined($conns[$c]->pg_result());
+			$done[$c] = 1;
+		}
+		usleep(1000);
+		die "round $i hung" if time() - $start > 60;
+	}
+	push @latencies, time() - $start;
+	$bad_rounds++ if $succeeded != 1;
+}
+
+is($bad_rounds, 0, "each contended commit prepared succeeded exactly once");
+
+$cluster->safe_psql(0, "select mtm.ping()");
+is($cluster->safe_psql(1, "select count(*) from gtx_race"), $rounds,
+   "prepared transactions are committed everywhere");
+
+my @sorted = sort { $a <=> $b } @latencies;
+note(sprintf("contended gid finish latency: median %.1f ms, max %.1f ms",
+			 1000 * $sorted[int($#sorted / 2)], 1000 * $sorted[-1]));
+
+$_->disconnect() foreach @conns;
+$cluster->stop();
@@ -0,0 +1,68 @@
+# Crash a coordinator under load a couple of times so that survivors (and the
+# node itself after restart, from its prepared xacts) have to resolve its
+# orphaned transactions. Check that everything gets resolved and that
+# resolver ballots never go back during lifetime of a postmaster.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Test::More tests => 3;
+
+my $cluster = new Cluster(3);
+$cluster->init();
+$cluster->start();
+$cluster->create_mm();
+
+$cluster->pgbench(0, ('-i', -s => '1'));
+
+foreach my $round (1..2)
+{
+	my $pgb = $cluster->pgbench_async(0, ('-n', -c => 5, -T => 10));
+	sleep(3);
+	$cluster->{nodes}->[0]->stop('immediate');
+	$cluster->await_nodes_after_stop([1, 2]);
+	$cluster->pgbench_await($pgb);
+	$cluster->{nodes}->[0]->start;
+	$cluster->await_nodes([0, 1, 2]);
+}
+
+my $resolved = 1;
+foreach my $i (0..2)
+{
+	$resolved &&= $cluster->poll_query_until($i,
+		"select count(*) = 0 from pg_prepared_xacts");
+}
+ok($resolved, "all orphaned transactions are resolved");
+ok($cluster->is_data_identic((0, 1, 2)), "data is the same on all nodes");
+
+$cluster->stop();
+
+# Terms generated by resolver are "new term is (ballot,node_id)" log lines;
+# within single postmaster lifetime each must be at least the previous one.
+my $monotonic = 1;
+my $n_terms = 0;
+foreach my $node (@{$cluster->{nodes}})
+{
+	my @prev = (0, 0);
+	foreach my $line (split /\n/, slurp_file($node->logfile))
+	{
+		if ($line =~ /database system is ready to accept connections/)
+		{
+			@prev = (0, 0);
+		}
+		elsif ($line =~ /new term is \((\d+),(\d+)\)/)
+		{
+			$n_terms++;
+			if ($1 < $prev[0] || ($1 == $prev[0] && $2 < $prev[1]))
+			{
+				note("term ($1,$2) after ($prev[0],$prev[1]) on " . $node->name);
+				$monotonic = 0;
+			}
+			@prev = ($1, $2);
+		}
+	}
+}
+note("resolver generated $n_terms terms");
+ok($monotonic, "resolver terms never go back");
@@ -0,0 +1,94 @@
+# Short transactions committed while the same node streams a bulk load, with
+# precommit going only through WAL and with direct precommit over dmq. Check
+# that everything is committed everywhere and report p50/p99 commit latency
+# for both modes.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Time::HiRes qw(time);
+
+# Test whether we have both DBI and DBD::pg
+my $dbdpg_rc = eval
+{
+  require DBI;
+  require DBD::Pg;
+  1;
+};
+
+require Test::More;
+if (not $dbdpg_rc)
+{
+	Test::More->import(skip_all => 'DBI and DBD::Pg are not available');
+}
+else
+{
+	Test::More->import(tests => 4);
+}
+
+my $cluster = new Cluster(3);
+$cluster->init();
+$cluster->start();
+$cluster->create_mm();
+
+$cluster->safe_psql(0, q{
+	create table bulk(id bigserial primary key, payload text);
+	create table short_xacts(id int primary key, mode text);
+});
+
+my $script = TestLib::tempdir() . '/bulk.sql';
+TestLib::append_to_file($script,
+	"insert into bulk(payload) select repeat('x', 200) from generate_series(1, 5000);\n");
+
+my $conn = DBI->connect('DBI:Pg:' . $cluster->connstr(0), undef, undef,
+						{ PrintError => 0, RaiseError => 1, AutoCommit => 1 });
+
+my $xacts = 300;
+my $id = 0;
+my %latencies;
+foreach my $mode ('off', 'on')
+{
+	$conn->do("set multimaster.direct_precommit = $mode");
+
+	my $pgb = $cluster->pgbench_async(0, ('-n', -f => $script, -c => 2, -T => 20));
+	sleep(2);
+
+	my @lat;
+	foreach my $i (1..$xacts)
+	{
+		$id++;
+		my $start = time();
+		$conn->do("insert into short_xacts values ($id, '$mode')");
+		push @lat, time() - $start;
+	}
+	$cluster->pgbench_await($pgb);
+	$latencies{$mode} = [ sort { $a <=> $b } @lat ];
+}
+$conn->disconnect();
+
+$cluster->safe_psql($_, "select mtm.ping()") foreach (0..2);
+is($cluster->safe_psql(1, "select count(*) from short_xacts"), 2 * $xacts,
+   "short transactions are committed everywhere");
+ok($cluster->poll_query_until(2, "select count(*) = 0 from pg_prepared_xacts"),
+   "no prepared transactions left");
+ok($cluster->is_data_identic((0, 1, 2)), "data is the same on all nodes");
+
+foreach my $mode ('off', 'on')
+{
+	my @s = @{$latencies{$mode}};
+	note(sprintf("direct_precommit=%s: commit latency p50 %.1f ms, p99 %.1f ms",
+				 $mode, 1000 * $s[int($#s * 0.5)], 1000 * $s[int($#s * 0.99)]));
+}
+
+$cluster->stop();
+
+# precommits written by repliers must not be streamed further as if they
+# were their own, replies to those would land on nobody's xid stream
+my $stray = 0;
+foreach my $node (@{$cluster->{nodes}})
+{
+	$stray += () = slurp_file($node->logfile) =~ /subscription xid\d+ is not found/g;
+}
+cmp_ok($stray, '<', $xacts, "no stray precommit replies per transaction");
@@ -0,0 +1,52 @@
+# pgbench on every node of 3- and 5-node clusters. Check that data converges
+# and report commit throughput along with how many dmq messages (mostly
+# prepare/precommit/commit acks) senders have packed into how many frames.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Test::More tests => 4;
+
+my $duration = 10;
+
+foreach my $n_nodes (3, 5)
+{
+	my $cluster = new Cluster($n_nodes);
+	$cluster->init();
+	$cluster->start();
+	$cluster->create_mm();
+
+	$cluster->pgbench(0, ('-i', -s => '1'));
+
+	my @pgbs = map {
+		$cluster->pgbench_async($_, ('-n', -c => 5, -T => $duration))
+	} (0..$n_nodes - 1);
+	$cluster->pgbench_await($_) foreach @pgbs;
+
+	$cluster->safe_psql($_, "select mtm.ping()") foreach (0..$n_nodes - 1);
+	my $xacts = $cluster->safe_psql(0, "select count(*) from pgbench_history");
+	ok($cluster->is_data_identic((0..$n_nodes - 1)),
+	   "data is the same on all $n_nodes nodes");
+
+	$cluster->stop();
+
+	my ($messages, $frames) = (0, 0);
+	foreach my $node (@{$cluster->{nodes}})
+	{
+		foreach my $line (split /\n/, slurp_file($node->logfile))
+		{
+			if ($line =~ /\[DMQ\] sent (\d+) messages in (\d+) frames/)
+			{
+				$messages += $1;
+				$frames += $2;
+			}
+		}
+	}
+	note(sprintf("%d nodes: %.0f tps, %.0f dmq messages/s in %.0f frames/s",
+				 $n_nodes, $xacts / $duration, $messages / $duration,
+				 $frames / $duration));
+	ok($frames > 0 && $frames <= $messages,
+	   "dmq senders of $n_nodes nodes reported their traffic");
+}
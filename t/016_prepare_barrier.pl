@@ -0,0 +1,46 @@
+# Every distributed commit enters the prepare barrier. Run pgbench with 1 to
+# 128 concurrent committers and report throughput; in the middle of the
+# heaviest run bounce a node so that generation switch has to take the
+# barrier under load. Check that data converges afterwards.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Test::More tests => 2;
+
+my $cluster = new Cluster(3);
+$cluster->init();
+foreach my $node (@{$cluster->{nodes}})
+{
+	$node->append_conf('postgresql.conf', q{max_connections = 200});
+}
+$cluster->start();
+$cluster->create_mm();
+
+$cluster->pgbench(0, ('-i', -s => '10'));
+
+my $duration = 5;
+foreach my $clients (1, 4, 16, 64, 128)
+{
+	my $start = $cluster->safe_psql(0, "select count(*) from pgbench_history");
+	my $pgb = $cluster->pgbench_async(0, ('-n', -N, -c => $clients, -j => 4,
+										  -T => $duration));
+	if ($clients == 128)
+	{
+		sleep(2);
+		$cluster->{nodes}->[2]->stop('fast');
+		$cluster->{nodes}->[2]->start;
+	}
+	$cluster->pgbench_await($pgb);
+	my $end = $cluster->safe_psql(0, "select count(*) from pgbench_history");
+	note(sprintf("%d preparers: %.0f tps", $clients, ($end - $start) / $duration));
+}
+
+$cluster->await_nodes([0, 1, 2]);
+ok($cluster->poll_query_until(0, "select count(*) = 0 from pg_prepared_xacts"),
+   "no prepared transactions left");
+ok($cluster->is_data_identic((0, 1, 2)), "data is the same on all nodes");
+
+$cluster->stop();
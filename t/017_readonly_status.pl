@@ -0,0 +1,46 @@
+# Every transaction start checks node status. Report read-only pgbench
+# throughput, then make sure the status seen at transaction start still
+# follows generation and connectivity changes: node without quorum refuses
+# transactions and accepts them again once peers are back.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Test::More tests => 2;
+use Time::HiRes qw(time);
+
+my $cluster = new Cluster(3);
+$cluster->init();
+$cluster->start();
+$cluster->create_mm();
+
+$cluster->pgbench(0, ('-i', -s => '1'));
+
+my $start = time();
+my $pgb = $cluster->pgbench_async(0, ('-n', -S, -c => 8, -j => 4, -t => 20000));
+$cluster->pgbench_await($pgb);
+note(sprintf("select-only: %.0f tps", 8 * 20000 / (time() - $start)));
+
+$cluster->{nodes}->[1]->stop;
+$cluster->{nodes}->[2]->stop;
+# status is not changed instantly; wait for it
+my $stderr = '';
+foreach my $i (1..60)
+{
+	(undef, undef, $stderr) = $cluster->{nodes}->[0]->psql('postgres',
+		"select count(*) from pgbench_accounts");
+	last if $stderr =~ /multimaster node is not online/;
+	sleep(1);
+}
+like($stderr, qr/multimaster node is not online/,
+	 "transactions are refused without quorum");
+
+$cluster->{nodes}->[1]->start;
+$cluster->{nodes}->[2]->start;
+$cluster->await_nodes([0, 1, 2]);
+is($cluster->safe_psql(0, "select count(*) from pgbench_accounts"), 100000,
+   "transactions are accepted again");
+
+$cluster->stop();
@@ -0,0 +1,65 @@
+# Transactions with nothing to replicate -- read-only ones, ones writing only
+# local tables and DML which changed nothing -- must commit locally without
+# 3PC. Report their throughput and check that no-op DML doesn't even consume
+# xids, while real writes done alongside still reach the other nodes.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Test::More tests => 3;
+use Time::HiRes qw(time);
+
+my $cluster = new Cluster(3);
+$cluster->init();
+$cluster->start();
+$cluster->create_mm();
+
+$cluster->pgbench(0, ('-i', -s => '1'));
+$cluster->safe_psql(0, q{
+	create table local_counter(id int primary key, n bigint);
+	select mtm.make_table_local('local_counter');
+	insert into local_counter select g, 0 from generate_series(1, 100) g;
+});
+
+my $dir = TestLib::tempdir();
+TestLib::append_to_file("$dir/local.sql", q{
+\set id random(1, 100)
+update local_counter set n = n + 1 where id = :id;
+});
+TestLib::append_to_file("$dir/noop.sql", q{
+update pgbench_accounts set abalance = abalance + 1 where aid < 0;
+});
+
+sub run
+{
+	my ($what, @args) = @_;
+	my $xacts = 4 * 5000;
+	my $start = time();
+	$cluster->pgbench(0, ('-n', -c => 4, -j => 4, -t => 5000, @args));
+	note(sprintf("%s: %.0f tps", $what, $xacts / (time() - $start)));
+}
+
+run('select-only', '-S');
+run('local table', -f => "$dir/local.sql");
+
+my $xid_before = $cluster->safe_psql(0, "select txid_current()");
+run('no-op update', -f => "$dir/noop.sql");
+my $xid_after = $cluster->safe_psql(0, "select txid_current()");
+cmp_ok($xid_after - $xid_before, '<', 100, "no-op updates don't assign xids");
+
+is($cluster->safe_psql(1, "select count(*) from local_counter"), 0,
+   "local table writes are not replicated");
+
+$cluster->safe_psql(0, q{
+	begin;
+	update local_counter set n = -1;
+	update pgbench_branches set bbalance = 42;
+	commit;
+});
+$cluster->safe_psql(0, "select mtm.ping()");
+is($cluster->safe_psql(2, "select count(*) from pgbench_branches where bbalance = 42"), 1,
+   "replicated table written with local one is replicated");
+
+$cluster->stop();
@@ -0,0 +1,91 @@
+# Session issuing back-to-back short transactions with a bit of think time
+# between them, with commit acks not waited for, waited for at commit and
+# waited for at the start of the next transaction. Report per-transaction
+# latency for each mode and check that in the pipelined mode a transaction
+# started after the commit already finds it applied on the other nodes.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Time::HiRes qw(time usleep);
+
+# Test whether we have both DBI and DBD::pg
+my $dbdpg_rc = eval
+{
+  require DBI;
+  require DBD::Pg;
+  1;
+};
+
+require Test::More;
+if (not $dbdpg_rc)
+{
+	Test::More->import(skip_all => 'DBI and DBD::Pg are not available');
+}
+else
+{
+	Test::More->import(tests => 2);
+}
+
+my $cluster = new Cluster(3);
+$cluster->init();
+$cluster->start();
+$cluster->create_mm();
+
+$cluster->safe_psql(0, "create table acks(id int primary key, mode text)");
+
+my $conn = DBI->connect('DBI:Pg:' . $cluster->connstr(0), undef, undef,
+						{ PrintError => 0, RaiseError => 1, AutoCommit => 1 });
+my @peers = map {
+	DBI->connect('DBI:Pg:' . $cluster->connstr($_), undef, undef,
+				 { PrintError => 0, RaiseError => 1, AutoCommit => 1 })
+} (1, 2);
+
+my %modes = (
+	'no wait' => [ 'off', 'off' ],
+	'wait at commit' => [ 'on', 'off' ],
+	'pipelined' => [ 'on', 'on' ],
+);
+my $xacts = 300;
+my $id = 0;
+my $missed = 0;
+foreach my $mode ('no wait', 'wait at commit', 'pipelined')
+{
+	$conn->do("set multimaster.wait_peer_commits = $modes{$mode}[0]");
+	$conn->do("set multimaster.pipeline_commit_acks = $modes{$mode}[1]");
+
+	my @lat;
+	foreach my $i (1..$xacts)
+	{
+		$id++;
+		my $start = time();
+		$conn->do("insert into acks values ($id, '$mode')");
+		push @lat, time() - $start;
+		usleep(1000);
+
+		next unless $mode eq 'pipelined' && $i % 10 == 0;
+		# next xact of the session waits for acks of this one
+		$conn->do("select 1");
+		foreach my $peer (@peers)
+		{
+			my ($n) = $peer->selectrow_array(
+				"select count(*) from acks where id = $id");
+			$missed++ if $n != 1;
+		}
+	}
+	my @s = sort { $a <=> $b } @lat;
+	note(sprintf("%s: commit latency p50 %.2f ms, p99 %.2f ms", $mode,
+				 1000 * $s[int($#s * 0.5)], 1000 * $s[int($#s * 0.99)]));
+}
+
+is($missed, 0, "acked transactions are visible on peers at next transaction start");
+
+$_->disconnect() foreach ($conn, @peers);
+
+$cluster->safe_psql(0, "select mtm.ping()");
+is($cluster->safe_psql(2, "select count(*) from acks"), 3 * $xacts,
+   "all transactions are committed everywhere");
+
+$cluster->stop();
@@ -0,0 +1,137 @@
+# Each locally coordinated commit keeps its global transaction in the
+# backend's own slot until its outcome is known.
+#
+# First, hold a coordinator right after precommit: peers' apply waits on a
+# local lock until the transaction is prepared everywhere, and walsenders of
+# the coordinator are stopped, so the precommit never reaches peers. Then
+# terminate the coordinator backend; its transaction of unknown outcome must
+# be handed over from the slot to resolver, which commits it without help of
+# the stopped walsenders.
+#
+# Second, stop both peers under load so that many coordinators exit the
+# commit sequence with precommitted transactions at once. Check that all of
+# them get resolved once the peers are back and that data converges.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Time::HiRes qw(usleep);
+
+# Test whether we have both DBI and DBD::pg
+my $dbdpg_rc = eval
+{
+  require DBI;
+  require DBD::Pg;
+  1;
+};
+
+require Test::More;
+if (not $dbdpg_rc)
+{
+	Test::More->import(skip_all => 'DBI and DBD::Pg are not available');
+}
+else
+{
+	Test::More->import(tests => 6);
+}
+
+my $cluster = new Cluster(3);
+$cluster->init();
+$cluster->{nodes}->[0]->append_conf('postgresql.conf',
+									q{multimaster.TxTrace_log_level = LOG});
+$cluster->start();
+$cluster->create_mm();
+
+sub dbi_connect
+{
+	my ($node_off) = @_;
+	return DBI->connect('DBI:Pg:' . $cluster->connstr($node_off), undef, undef,
+						{ PrintError => 0, RaiseError => 1, AutoCommit => 1 });
+}
+
+# wait until the log of node 0 past $offset matches $re
+sub await_log
+{
+	my ($offset, $re) = @_;
+	foreach my $i (1..1800)
+	{
+		my $log = slurp_file($cluster->{nodes}->[0]->logfile);
+		return 1 if substr($log, $offset) =~ $re;
+		usleep(100_000);
+	}
+	return 0;
+}
+
+$cluster->safe_psql(0, "create table slot_t(id int primary key)");
+
+my @lockers = map { dbi_connect($_) } (1, 2);
+foreach my $locker (@lockers)
+{
+	$locker->begin_work();
+	$locker->do("lock table slot_t in access exclusive mode");
+}
+
+my $coord = dbi_connect(0);
+my ($coord_pid) = $coord->selectrow_array("select pg_backend_pid()");
+my $offset = -s $cluster->{nodes}->[0]->logfile;
+# Since we are not importing DBD::Pg at compilation time, we can't use
+# constants from it.
+my $DBD_PG_PG_ASYNC = 1;
+$coord->do("insert into slot_t values (1)", { pg_async => $DBD_PG_PG_ASYNC });
+
+foreach my $i (1, 2)
+{
+	$cluster->poll_query_until($i,
+		"select count(*) > 0 from pg_locks where relation = 'slot_t'::regclass and not granted");
+}
+my @walsenders = split /\n/,
+	$cluster->safe_psql(0, "select pid from pg_stat_replication");
+kill 'STOP', @walsenders;
+$_->commit() foreach @lockers;
+
+ok(await_log($offset, qr/MTM-\S+ precommitted/),
+   "coordinator precommits with walsenders stopped");
+$cluster->safe_psql(0, "select pg_terminate_backend($coord_pid)");
+ok($cluster->poll_query_until(0,
+	"select count(*) = 0 from pg_prepared_xacts where gid like 'MTM-%'"),
+   "resolver finishes transaction of terminated coordinator");
+
+kill 'CONT', @walsenders;
+$_->disconnect() foreach (@lockers);
+$cluster->await_nodes([0, 1, 2]);
+is($cluster->safe_psql(2, "select count(*) from slot_t"), 1,
+   "transaction of terminated coordinator is committed everywhere");
+
+$cluster->pgbench(0, ('-i', -s => '1'));
+
+my $pgb = $cluster->pgbench_async(0, ('-n', -N, -c => 16, -T => 10));
+sleep(3);
+$cluster->{nodes}->[1]->stop('immediate');
+$cluster->{nodes}->[2]->stop('immediate');
+$cluster->pgbench_await($pgb);
+
+# node 0 is alone now and can't resolve anything; all its committers are
+# gone, so whatever is left prepared has been handed over to resolver
+my $prepared = $cluster->safe_psql(0, "select count(*) from pg_prepared_xacts");
+note("$prepared transactions are left prepared on coordinator");
+
+$cluster->{nodes}->[1]->start;
+$cluster->{nodes}->[2]->start;
+$cluster->await_nodes([0, 1, 2]);
+
+my $resolved = 1;
+foreach my $i (0..2)
+{
+	$resolved &&= $cluster->poll_query_until($i,
+		"select count(*) = 0 from pg_prepared_xacts");
+}
+ok($resolved, "all transactions are resolved");
+ok($cluster->is_data_identic((0, 1, 2)), "data is the same on all nodes");
+
+$cluster->stop();
+
+my $stuck = () = slurp_file($cluster->{nodes}->[0]->logfile)
+	=~ /no shared memory to hand over transaction/g;
+is($stuck, 0, "all transactions are handed over without retries");
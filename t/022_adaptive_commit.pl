@@ -0,0 +1,93 @@
+# Commits skipping the precommit round while the cluster is healthy. Compare
+# commit latency of a single session with and without it, then crash a
+# coordinator and a peer under load: transactions left in doubt must be
+# resolved once the coordinator is back, and data must converge.
+
+use strict;
+use warnings;
+
+use Cluster;
+use TestLib;
+use Time::HiRes qw(time);
+
+# Test whether we have both DBI and DBD::pg
+my $dbdpg_rc = eval
+{
+  require DBI;
+  require DBD::Pg;
+  1;
+};
+
+require Test::More;
+if (not $dbdpg_rc)
+{
+	Test::More->import(skip_all => 'DBI and DBD::Pg are not available');
+}
+else
+{
+	Test::More->import(tests => 3);
+}
+
+my $cluster = new Cluster(3);
+$cluster->init();
+$cluster->start();
+$cluster->create_mm();
+
+$cluster->safe_psql(0, "create table adaptive(id int primary key)");
+
+my $conn = DBI->connect('DBI:Pg:' . $cluster->connstr(0), undef, undef,
+						{ PrintError => 0, RaiseError => 1, AutoCommit => 1 });
+my $xacts = 500;
+my $id = 0;
+foreach my $adaptive ('off', 'on')
+{
+	$conn->do("set multimaster.adaptive_commit = $adaptive");
+	my @lat;
+	foreach my $i (1..$xacts)
+	{
+		$id++;
+		my $start = time();
+		$conn->do("insert into adaptive values ($id)");
+		push @lat, time() - $start;
+	}
+	my @s = sort { $a <=> $b } @lat;
+	note(sprintf("adaptive_commit %s: commit latency p50 %.2f ms, p99 %.2f ms",
+				 $adaptive, 1000 * $s[int($#s * 0.5)], 1000 * $s[int($#s * 0.99)]));
+}
+$conn->disconnect();
+
+$cluster->safe_psql(0, "select mtm.ping()");
+is($cluster->safe_psql(1, "select count(*) from adaptive"), 2 * $xacts,
+   "transactions are committed everywhere");
+
+foreach my $node (@{$cluster->{nodes}})
+{
+	$node->append_conf('postgresql.conf', q{multimaster.adaptive_commit = on});
+	$node->reload;
+}
+$cluster->pgbench(0, ('-i', -s => '1'));
+
+foreach my $victim (0, 2)
+{
+	my @pgbs = map {
+		$cluster->pgbench_async($_, ('-n', -c => 5, -T => 10))
+	} (0, 1);
+	sleep(3);
+	$cluster->{nodes}->[$victim]->stop('immediate');
+	$cluster->await_nodes_after_stop([grep { $_ != $victim } (0..2)]);
+	# in-doubt xacts of crashed coordinator block others until it is back
+	$cluster->{nodes}->[$victim]->start;
+	$cluster->pgbench_await($_) foreach @pgbs;
+	$cluster->await_nodes([0, 1, 2]);
+}
+
+my $resolved = 1;
+foreach my $i (0..2)
+{
+	$resolved &&= $cluster->poll_query_until($i,
+		"select count(*) = 0 from pg_prepared_xacts");
+}
+ok($resolved, "all transactions are resolved");
+ok($cluster->is_data_identic((0, 1, 2)), "data is the same on all nodes");
+
+$cluster->stop();